@@ -0,0 +1,126 @@
+#include <iterator>
+#include <random>
+#include "generator.hpp"
+
+namespace yk {
+namespace bench {
+
+/**
+ * Helper to append random pieces of source to a string.
+ */
+struct writer {
+	explicit writer(generator_options const& opts)
+		: m_Options(opts), m_Random(opts.seed) {
+	}
+
+	std::string const& text() const { return m_Text; }
+
+	bool chance(double p) {
+		return std::uniform_real_distribution<double>(0.0, 1.0)(m_Random) < p;
+	}
+
+	u32 below(u32 n) {
+		return std::uniform_int_distribution<u32>(0, n - 1)(m_Random);
+	}
+
+	void name() {
+		// A limited pool, so names repeat like in real code
+		static char const* const prefixes[] = {
+			"foo", "bar", "main", "print", "alloc", "read_file", "x", "vec_push",
+		};
+		m_Text += prefixes[below(std::size(prefixes))];
+		m_Text += '_';
+		m_Text += std::to_string(below(512));
+	}
+
+	void words() {
+		static char const* const pool[] = {
+			"the", "parser", "should", "handle", "this", "case", "TODO:", "fn",
+			"x = 1;", "{ }", "*", "/",
+		};
+		for (u32 n = 1 + below(8); n > 0; --n) {
+			m_Text += pool[below(std::size(pool))];
+			m_Text += ' ';
+		}
+	}
+
+	void line_comment() {
+		m_Text += "// ";
+		words();
+		m_Text += '\n';
+	}
+
+	void nested_comment(u32 depth) {
+		m_Text += "/* ";
+		words();
+		if (depth > 1 && chance(0.5)) {
+			nested_comment(depth - 1);
+		}
+		if (chance(0.3)) {
+			m_Text += "\n   ";
+		}
+		words();
+		m_Text += "*/";
+	}
+
+	void comment() {
+		if (m_Options.nesting_depth == 0 || chance(0.5)) {
+			line_comment();
+		}
+		else {
+			nested_comment(1 + below(m_Options.nesting_depth));
+			m_Text += '\n';
+		}
+	}
+
+	void declaration() {
+		// One of the parts gets damaged
+		u32 broken = chance(m_Options.error_rate) ? 1 + below(5) : 0;
+		m_Text += "fn ";
+		if (broken == 1) {
+			// Unexpected character
+			m_Text += '$';
+		}
+		if (broken == 2) {
+			// Not an identifier
+			m_Text += std::to_string(below(1000));
+		}
+		else {
+			name();
+		}
+		m_Text += (broken == 3) ? "(" : "()";
+		if (chance(0.5)) {
+			m_Text += " foreign";
+			m_Text += (broken == 4) ? "\n" : ";\n";
+		}
+		else {
+			m_Text += " {\n";
+			m_Text += (broken == 5) ? "\n" : "}\n";
+		}
+	}
+
+	void item() {
+		if (chance(m_Options.comment_density)) {
+			comment();
+		}
+		else {
+			declaration();
+		}
+	}
+
+private:
+	generator_options const& m_Options;
+	std::mt19937 m_Random;
+	std::string m_Text;
+};
+
+std::string generate(generator_options const& opts) {
+	auto w = writer(opts);
+	while (w.text().size() < opts.size) {
+		w.item();
+	}
+	return w.text();
+}
+
+} /* namespace bench */
+} /* namespace yk */
@@ -0,0 +1,42 @@
+/**
+ * generator.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Synthetic Yoakke source generator for the benchmarks.
+ */
+
+#ifndef YK_BENCH_GENERATOR_HPP
+#define YK_BENCH_GENERATOR_HPP
+
+#include <cstddef>
+#include <string>
+#include <yk/common.hpp>
+
+namespace yk {
+namespace bench {
+
+/**
+ * The shape of the generated source.
+ */
+struct generator_options {
+	std::size_t size = 8 * 1024 * 1024; // Approximate size in bytes
+	double comment_density = 0.3; // The ratio of comments to declarations
+	u32 nesting_depth = 3; // Maximum nesting depth of nested comments
+	double error_rate = 0.01; // The ratio of declarations with an error
+	u32 seed = 0; // Seed of the random generator
+};
+
+/**
+ * Generates a random, but deterministic source text. It consists of function
+ * declarations and definitions, line and nested comments. A portion of the
+ * declarations contain a lexical or syntax error.
+ * @param opts The shape of the source.
+ * @return The generated source text.
+ */
+std::string generate(generator_options const& opts);
+
+} /* namespace bench */
+} /* namespace yk */
+
+#endif /* YK_BENCH_GENERATOR_HPP */
@@ -0,0 +1,163 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <convert.hpp>
+#include <yk/alloc_counter.hpp>
+#include <yk/compilation.hpp>
+#include <yk/error.hpp>
+#include <yk/lexer.hpp>
+#include <yk/source.hpp>
+#include "generator.hpp"
+
+/**
+ * The measured cost of a single phase.
+ */
+struct phase_result {
+	char const* name;
+	double seconds;
+	std::size_t allocations;
+};
+
+/**
+ * Runs a phase, measuring the elapsed time and the allocations made.
+ * @param name The name of the phase to report.
+ * @param fn The function to execute.
+ * @return The measurements.
+ */
+template <typename Fn>
+static phase_result measure(char const* name, Fn&& fn) {
+	// The phases run on this thread, so it's allocations are all of them
+	auto allocs = yk::thread_allocations();
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	auto end = std::chrono::steady_clock::now();
+	return phase_result{
+		name,
+		std::chrono::duration<double>(end - start).count(),
+		std::size_t(yk::thread_allocations() - allocs)
+	};
+}
+
+static void usage(char const* exe) {
+	std::cerr
+		<< "Usage: " << exe << " [options]\n"
+		<< "  --size <bytes>       Approximate size of the generated source\n"
+		<< "  --comments <ratio>   Ratio of comments to declarations\n"
+		<< "  --nesting <depth>    Maximum nesting depth of nested comments\n"
+		<< "  --errors <ratio>     Ratio of declarations with an error\n"
+		<< "  --seed <n>           Seed of the random generator\n"
+		<< "  --runs <n>           Number of measured runs, the best is reported\n";
+}
+
+int main(int argc, char** argv) {
+	auto opts = yk::bench::generator_options();
+	yk::u32 runs = 5;
+	for (int i = 1; i < argc; ++i) {
+		if (i + 1 == argc) {
+			usage(argv[0]);
+			return 1;
+		}
+		auto arg = argv[i];
+		auto val = argv[++i];
+		if (std::strcmp(arg, "--size") == 0) {
+			opts.size = std::strtoull(val, nullptr, 10);
+		}
+		else if (std::strcmp(arg, "--comments") == 0) {
+			opts.comment_density = std::strtod(val, nullptr);
+		}
+		else if (std::strcmp(arg, "--nesting") == 0) {
+			opts.nesting_depth = yk::u32(std::strtoul(val, nullptr, 10));
+		}
+		else if (std::strcmp(arg, "--errors") == 0) {
+			opts.error_rate = std::strtod(val, nullptr);
+		}
+		else if (std::strcmp(arg, "--seed") == 0) {
+			opts.seed = yk::u32(std::strtoul(val, nullptr, 10));
+		}
+		else if (std::strcmp(arg, "--runs") == 0) {
+			runs = yk::u32(std::strtoul(val, nullptr, 10));
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (runs == 0) {
+		runs = 1;
+	}
+
+	yk::err::init();
+	auto src = yk::source(yk::bench::generate(opts));
+
+	std::vector<phase_result> best;
+	std::size_t tok_count = 0;
+	std::size_t err_count = 0;
+	for (yk::u32 r = 0; r < runs; ++r) {
+		yk::err::clear();
+		auto syms = yk::interner();
+		std::vector<yk::token> toks;
+		std::optional<yk::compilation_unit> unit;
+		std::vector<yk::err::error_t> errs;
+		std::vector<lsp::diagnostic> diags;
+
+		std::vector<phase_result> results;
+		results.push_back(measure("lexer::all", [&] {
+			toks = yk::lexer::all(src, syms);
+		}));
+		results.push_back(measure("parser::all", [&] {
+			unit.emplace(toks);
+		}));
+		results.push_back(measure("err::errors", [&] {
+			errs = yk::err::errors();
+		}));
+		results.push_back(measure("error_to_diagnostic", [&] {
+			diags.reserve(errs.size());
+			for (auto const& err : errs) {
+				diags.push_back(error_to_diagnostic(err));
+			}
+		}));
+
+		tok_count = toks.size();
+		err_count = errs.size();
+		if (best.empty()) {
+			best = std::move(results);
+			continue;
+		}
+		for (std::size_t i = 0; i < best.size(); ++i) {
+			if (results[i].seconds < best[i].seconds) {
+				best[i] = results[i];
+			}
+		}
+	}
+
+	double mbytes = double(src.size()) / (1024.0 * 1024.0);
+	std::cout
+		<< "Source: " << src.size() << " bytes, "
+		<< tok_count << " tokens, "
+		<< err_count << " errors (best of " << runs << " runs)\n";
+	double total = 0.0;
+	for (auto const& res : best) {
+		total += res.seconds;
+		std::cout
+			<< "  " << res.name << ": "
+			<< res.seconds * 1000.0 << " ms, "
+			<< res.allocations << " allocations";
+		if (res.seconds > 0.0) {
+			std::cout
+				<< ", " << mbytes / res.seconds << " MB/s"
+				<< ", " << double(tok_count) / res.seconds << " tokens/s";
+		}
+		std::cout << '\n';
+	}
+	if (total > 0.0) {
+		std::cout
+			<< "  total: " << total * 1000.0 << " ms, "
+			<< mbytes / total << " MB/s, "
+			<< double(tok_count) / total << " tokens/s\n";
+	}
+	return 0;
+}
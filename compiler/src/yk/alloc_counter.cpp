@@ -0,0 +1,39 @@
+#include <cstdlib>
+#include <new>
+#include "alloc_counter.hpp"
+
+// Every allocation of the executable goes through here, so the phases can
+// report how many heap blocks they needed. The counters are per-thread, so
+// counting costs no synchronization.
+
+static thread_local yk::u64 t_Allocations = 0;
+static thread_local yk::u64 t_Bytes = 0;
+
+void* operator new(std::size_t size) {
+	++t_Allocations;
+	t_Bytes += size;
+	if (void* p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+namespace yk {
+
+u64 thread_allocations() {
+	return t_Allocations;
+}
+
+u64 thread_allocated_bytes() {
+	return t_Bytes;
+}
+
+} /* namespace yk */
@@ -0,0 +1,33 @@
+/**
+ * alloc_counter.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Counting of the heap allocations. Linking this replaces the
+ * global operator new of the executable, so only the tools that measure
+ * themselves link it, never the library.
+ */
+
+#ifndef YK_ALLOC_COUNTER_HPP
+#define YK_ALLOC_COUNTER_HPP
+
+#include "common.hpp"
+
+namespace yk {
+
+/**
+ * Returns the number of allocations made by the calling thread so far. Only
+ * the allocations through the global operator new are counted.
+ * @return The allocation count.
+ */
+u64 thread_allocations();
+
+/**
+ * Returns the number of bytes allocated by the calling thread so far.
+ * @return The allocated bytes.
+ */
+u64 thread_allocated_bytes();
+
+} /* namespace yk */
+
+#endif /* YK_ALLOC_COUNTER_HPP */
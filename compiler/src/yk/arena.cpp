@@ -0,0 +1,66 @@
+#include <algorithm>
+#include "arena.hpp"
+
+namespace yk {
+
+// Chunks are not doubled above this size, so a huge compilation does not
+// reserve much more than it uses
+static constexpr std::size_t max_chunk_size = 4 * 1024 * 1024;
+
+arena::arena(std::size_t chunk_size)
+	: m_Chunks(nullptr), m_Ptr(0), m_End(0),
+	m_NextSize(chunk_size), m_Capacity(0) {
+}
+
+arena::~arena() {
+	clear();
+}
+
+void arena::clear() {
+	// Chunks grow geometrically, so there are only a few of them no matter how
+	// many objects were allocated
+	while (m_Chunks) {
+		auto prev = m_Chunks->prev;
+		::operator delete(m_Chunks);
+		m_Chunks = prev;
+	}
+	m_Ptr = 0;
+	m_End = 0;
+	m_Capacity = 0;
+}
+
+void arena::adopt(arena& other) {
+	if (!other.m_Chunks) {
+		return;
+	}
+	// Link the other list in after ours, the current chunk stays in use
+	auto* tail = other.m_Chunks;
+	while (tail->prev) {
+		tail = tail->prev;
+	}
+	tail->prev = m_Chunks;
+	m_Chunks = other.m_Chunks;
+	m_Capacity += other.m_Capacity;
+	other.m_Chunks = nullptr;
+	other.m_Ptr = 0;
+	other.m_End = 0;
+	other.m_Capacity = 0;
+}
+
+void* arena::allocate_slow(std::size_t size, std::size_t align) {
+	auto header = sizeof(chunk) + align;
+	auto chunk_size = std::max(m_NextSize, size + header);
+	auto* c = static_cast<chunk*>(::operator new(chunk_size));
+	c->prev = m_Chunks;
+	m_Chunks = c;
+	m_Capacity += chunk_size;
+	m_NextSize = std::min(m_NextSize * 2, max_chunk_size);
+
+	auto begin = reinterpret_cast<std::uintptr_t>(c) + sizeof(chunk);
+	auto p = (begin + (align - 1)) & ~std::uintptr_t(align - 1);
+	m_Ptr = p + size;
+	m_End = reinterpret_cast<std::uintptr_t>(c) + chunk_size;
+	return reinterpret_cast<void*>(p);
+}
+
+} /* namespace yk */
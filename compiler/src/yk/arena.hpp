@@ -0,0 +1,160 @@
+/**
+ * arena.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description A bump allocator for objects that share the same lifetime, like
+ * the nodes of an AST.
+ */
+
+#ifndef YK_ARENA_HPP
+#define YK_ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "common.hpp"
+
+namespace yk {
+
+/**
+ * A bump allocator. Memory is handed out from large chunks by advancing a
+ * pointer, individual allocations are never freed. Every chunk is released at
+ * once, when the arena is destroyed or cleared. Destructors of the objects
+ * are never called, so the objects either have to be trivially destructible,
+ * or only own memory that is also allocated from the arena.
+ */
+struct arena {
+	/**
+	 * Creates an empty arena. No memory is allocated until the first request.
+	 * @param chunk_size The size of the first chunk in bytes. Later chunks
+	 * double in size.
+	 */
+	explicit arena(std::size_t chunk_size = 16 * 1024);
+
+	// The allocators point to the arena, so it can't be moved
+	arena(arena const&) = delete;
+	arena(arena&&) = delete;
+	arena& operator=(arena const&) = delete;
+	arena& operator=(arena&&) = delete;
+
+	~arena();
+
+	/**
+	 * Allocates uninitialized memory.
+	 * @param size The size of the allocation in bytes.
+	 * @param align The required alignment, must be a power of 2.
+	 * @return The pointer to the allocated memory.
+	 */
+	void* allocate(std::size_t size, std::size_t align) {
+		auto p = (m_Ptr + (align - 1)) & ~std::uintptr_t(align - 1);
+		if (p + size > m_End || m_Ptr == 0) {
+			return allocate_slow(size, align);
+		}
+		m_Ptr = p + size;
+		return reinterpret_cast<void*>(p);
+	}
+
+	/**
+	 * Constructs an object in the arena.
+	 * @param params The constructor arguments.
+	 * @return The pointer to the constructed object.
+	 */
+	template <typename T, typename... TFwd>
+	T* make(TFwd&&... params) {
+		void* mem = allocate(sizeof(T), alignof(T));
+		return new (mem) T(std::forward<TFwd>(params)...);
+	}
+
+	/**
+	 * Takes over the chunks of another arena, so the objects allocated there
+	 * live as long as this arena. Used to merge the arenas of parallel tasks.
+	 * The other arena becomes empty, but stays usable.
+	 * @param other The arena to take the chunks from.
+	 */
+	void adopt(arena& other);
+
+	/**
+	 * Releases every chunk. All the memory handed out by the arena becomes
+	 * invalid.
+	 */
+	void clear();
+
+	/**
+	 * Returns the number of bytes allocated from the system.
+	 * @return The sum of the chunk sizes.
+	 */
+	std::size_t capacity() const { return m_Capacity; }
+
+private:
+	/**
+	 * Allocates a new chunk, that is big enough for the request and allocates
+	 * from it.
+	 * @param size The size of the allocation in bytes.
+	 * @param align The required alignment.
+	 * @return The pointer to the allocated memory.
+	 */
+	void* allocate_slow(std::size_t size, std::size_t align);
+
+	// The chunks are linked through their headers, the newest is the head
+	struct chunk {
+		chunk* prev;
+	};
+
+	chunk* m_Chunks;
+	std::uintptr_t m_Ptr;
+	std::uintptr_t m_End;
+	std::size_t m_NextSize;
+	std::size_t m_Capacity;
+};
+
+/**
+ * A standard allocator adapter, so containers can be stored in the arena.
+ * Deallocation is a no-op, the memory is reclaimed with the arena.
+ */
+template <typename T>
+struct arena_allocator {
+	using value_type = T;
+	// Moving a container moves it's memory, which is fine within an arena
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	/**
+	 * Creates an allocator that allocates from the given arena.
+	 * @param a The arena to allocate from.
+	 */
+	explicit arena_allocator(arena& a) noexcept
+		: m_Arena(&a) {
+	}
+
+	template <typename U>
+	arena_allocator(arena_allocator<U> const& other) noexcept
+		: m_Arena(&other.get_arena()) {
+	}
+
+	T* allocate(std::size_t n) {
+		return static_cast<T*>(m_Arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, std::size_t) noexcept { }
+
+	arena& get_arena() const { return *m_Arena; }
+
+private:
+	arena* m_Arena;
+};
+
+template <typename T, typename U>
+bool operator==(arena_allocator<T> const& a, arena_allocator<U> const& b) {
+	return &a.get_arena() == &b.get_arena();
+}
+
+template <typename T, typename U>
+bool operator!=(arena_allocator<T> const& a, arena_allocator<U> const& b) {
+	return !(a == b);
+}
+
+} /* namespace yk */
+
+#endif /* YK_ARENA_HPP */
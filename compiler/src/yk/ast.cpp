@@ -7,12 +7,12 @@ namespace yk {
 // Block expression
 
 expr::block expr::block::make(token const& lbr, token const& rbr,
-	std::vector<stmt*>&& stmts, expr* val) {
+	stmt_list&& stmts, expr* val) {
 	return block(lbr.range_(), rbr.range_(), std::move(stmts), val);
 }
 
 expr::block::block(std::optional<range>&& start, std::optional<range>&& end,
-	std::vector<stmt*>&& stmts, expr* val)
+	stmt_list&& stmts, expr* val)
 	: m_StartBrace(std::move(start)), m_EndBrace(std::move(end)),
 	m_Statements(std::move(stmts)), m_ReturnValue(val) {
 }
@@ -22,11 +22,11 @@ expr::block::block(std::optional<range>&& start, std::optional<range>&& end,
 // Function declaration
 
 stmt::fdecl stmt::fdecl::make(token const& name) {
-	return fdecl(make_terminal(name.value(), name.range_()), std::nullopt);
+	return fdecl(make_terminal(name.name(), name.range_()), std::nullopt);
 }
 
-stmt::fdecl::fdecl(terminal<std::string>&& name,
-	std::optional<terminal<std::string>>&& extName)
+stmt::fdecl::fdecl(terminal<symbol>&& name,
+	std::optional<terminal<symbol>>&& extName)
 	: m_Name(std::move(name)), m_ExternName(std::move(extName)) {
 }
 
@@ -34,14 +34,14 @@ stmt::fdecl::fdecl(terminal<std::string>&& name,
 
 stmt::fdef stmt::fdef::make(token const& name, expr::block&& block) {
 	return fdef(
-		make_terminal(name.value(), name.range_()),
+		make_terminal(name.name(), name.range_()),
 		std::nullopt,
 		std::move(block)
 	);
 }
 
-stmt::fdef::fdef(terminal<std::string>&& name,
-	std::optional<terminal<std::string>>&& expName,
+stmt::fdef::fdef(terminal<symbol>&& name,
+	std::optional<terminal<symbol>>&& expName,
 	expr::block&& body)
 	: m_Name(std::move(name)), m_ExportName(std::move(expName)),
 	m_Body(std::move(body)) {
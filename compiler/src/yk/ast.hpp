@@ -10,13 +10,16 @@
 #define YK_AST_HPP
 
 #include <optional>
+#include <vector>
+#include "arena.hpp"
 #include "common.hpp"
+#include "interner.hpp"
 #include "lexer.hpp"
 
 #define make_heap(base) 									\
 template <typename... TFwd> 								\
-static base* make_##base(TFwd&&... params) { 				\
-	return new base(make(std::forward<TFwd>(params)...));	\
+static base* make_##base(arena& a, TFwd&&... params) { 		\
+	return a.make<base>(make(std::forward<TFwd>(params)...));	\
 }
 
 #define make_e() make_heap(expr)
@@ -27,6 +30,24 @@ namespace yk {
 struct expr;
 struct stmt;
 
+/**
+ * A list of statements. The nodes and the list itself are allocated from the
+ * arena of the compilation, so none of them need to be freed one by one.
+ */
+using stmt_list = std::vector<stmt*, arena_allocator<stmt*>>;
+
+/**
+ * Moves an optional range with a position mapping.
+ * @param r The range to move.
+ * @param fn The function that maps an old position to the new one.
+ */
+template <typename Fn>
+void relocate(std::optional<range>& r, Fn const& fn) {
+	if (r) {
+		r = range(fn(r->start()), fn(r->end()));
+	}
+}
+
 /**
  * An atomic/terminal value, that could be an identifier, a symbol, or any
  * terminal that could appear in the AST. It has an optional position, because
@@ -49,6 +70,9 @@ struct terminal {
 	terminal(TF&& val, std::optional<range>&& pos = std::nullopt)
 		: value(std::forward<TF>(val)), pos(pos) {
 	}
+
+	template <typename Fn>
+	void relocate(Fn const& fn) { yk::relocate(pos, fn); }
 };
 
 template <typename T>
@@ -58,7 +82,8 @@ make_terminal(T&& val, std::optional<range> pos = std::nullopt) {
 }
 
 /**
- * ADT of expression nodes.
+ * ADT of expression nodes. Nodes are allocated in an arena, so they must only
+ * own memory from the same arena.
  */
 struct expr {
 	/**
@@ -74,18 +99,31 @@ struct expr {
 		 * @return The created block expression.
 		 */
 		static block make(token const& lbr, token const& rbr,
-			std::vector<stmt*>&& stmts, expr* val);
+			stmt_list&& stmts, expr* val);
 		make_e();
 
 		block(block&&) = default;
 
+		auto const& start_brace() const { return m_StartBrace; }
+		auto const& end_brace() const { return m_EndBrace; }
+		auto const& statements() const { return m_Statements; }
+		expr const* return_value() const { return m_ReturnValue; }
+
+		/**
+		 * Moves every position in the block, like when it's reused after an
+		 * edit before it.
+		 * @param fn The function that maps an old position to the new one.
+		 */
+		template <typename Fn>
+		void relocate(Fn const& fn);
+
 	private:
 		block(std::optional<range>&& start, std::optional<range>&& end,
-			std::vector<stmt*>&& stmts, expr* val);
+			stmt_list&& stmts, expr* val);
 
 		std::optional<range> m_StartBrace;
 		std::optional<range> m_EndBrace;
-		std::vector<stmt*> m_Statements;
+		stmt_list m_Statements;
 		expr* m_ReturnValue;
 	};
 
@@ -104,6 +142,11 @@ struct expr {
 	expr(T&& val)
 		: node(std::forward<T>(val)) {
 	}
+
+	template <typename Fn>
+	void relocate(Fn const& fn) {
+		std::visit([&](auto& n) { n.relocate(fn); }, node);
+	}
 };
 
 /**
@@ -127,12 +170,21 @@ struct stmt {
 
 		fdecl(fdecl&&) = default;
 
+		auto const& name() const { return m_Name; }
+		auto const& extern_name() const { return m_ExternName; }
+
+		template <typename Fn>
+		void relocate(Fn const& fn) {
+			m_Name.relocate(fn);
+			if (m_ExternName) m_ExternName->relocate(fn);
+		}
+
 	private:
-		fdecl(terminal<std::string>&& name,
-			std::optional<terminal<std::string>>&& extName);
+		fdecl(terminal<symbol>&& name,
+			std::optional<terminal<symbol>>&& extName);
 
-		terminal<std::string> m_Name;
-		std::optional<terminal<std::string>> m_ExternName;
+		terminal<symbol> m_Name;
+		std::optional<terminal<symbol>> m_ExternName;
 	};
 
 	/**
@@ -152,13 +204,24 @@ struct stmt {
 
 		fdef(fdef&&) = default;
 
+		auto const& name() const { return m_Name; }
+		auto const& export_name() const { return m_ExportName; }
+		auto const& body() const { return m_Body; }
+
+		template <typename Fn>
+		void relocate(Fn const& fn) {
+			m_Name.relocate(fn);
+			if (m_ExportName) m_ExportName->relocate(fn);
+			m_Body.relocate(fn);
+		}
+
 	private:
-		fdef(terminal<std::string>&& name,
-			std::optional<terminal<std::string>>&& expName,
+		fdef(terminal<symbol>&& name,
+			std::optional<terminal<symbol>>&& expName,
 			expr::block&& body);
 
-		terminal<std::string> m_Name;
-		std::optional<terminal<std::string>> m_ExportName;
+		terminal<symbol> m_Name;
+		std::optional<terminal<symbol>> m_ExportName;
 		expr::block m_Body;
 	};
 
@@ -177,8 +240,29 @@ struct stmt {
 	stmt(T&& val)
 		: node(std::forward<T>(val)) {
 	}
+
+	/**
+	 * Moves every position in the statement.
+	 * @param fn The function that maps an old position to the new one.
+	 */
+	template <typename Fn>
+	void relocate(Fn const& fn) {
+		std::visit([&](auto& n) { n.relocate(fn); }, node);
+	}
 };
 
+template <typename Fn>
+void expr::block::relocate(Fn const& fn) {
+	yk::relocate(m_StartBrace, fn);
+	yk::relocate(m_EndBrace, fn);
+	for (auto* s : m_Statements) {
+		s->relocate(fn);
+	}
+	if (m_ReturnValue) {
+		m_ReturnValue->relocate(fn);
+	}
+}
+
 } /* namespace yk */
 
 #undef make_heap
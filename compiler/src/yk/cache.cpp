@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "cache.hpp"
+#include "compilation.hpp"
+
+namespace yk {
+
+// "YKPC" read as a little-endian u32
+static constexpr u32 cache_magic = 0x43504b59;
+// Has to be increased whenever the layout of the records or the grammar
+// changes, as the nodes are rebuilt from the token indices
+static constexpr u32 cache_version = 3;
+
+/**
+ * Continues an FNV-1a hash with more bytes.
+ * @param h The hash so far.
+ * @param bytes The bytes to add.
+ * @return The new hash.
+ */
+static u64 fnv1a(u64 h, std::string_view bytes) {
+	for (char c : bytes) {
+		h ^= u8(c);
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+u64 content_hash(std::string_view text) {
+	return fnv1a(0xcbf29ce484222325ull, text);
+}
+
+/**
+ * Hashes a cache file, except for the checksum in it's header.
+ * @param bytes The bytes of the file.
+ * @param size The size of the file, at least the size of the header.
+ * @return The checksum of the file.
+ */
+static u64 checksum_of(u8 const* bytes, std::size_t size) {
+	auto const* chars = reinterpret_cast<char const*>(bytes);
+	auto h = content_hash(std::string_view(chars, offsetof(cache_header, checksum)));
+	return fnv1a(h, std::string_view(
+		chars + sizeof(cache_header), size - sizeof(cache_header)));
+}
+
+/**
+ * Returns a description string, that lives until the end of the program.
+ * Errors only refer to their descriptions, while the cached strings are gone
+ * with the mapped file.
+ * @param str The description.
+ * @return The pointer to the stored, null-terminated copy.
+ */
+static char const* description(std::string_view str) {
+	static std::mutex lock;
+	static std::unordered_set<std::string> strings;
+	auto guard = std::lock_guard<std::mutex>(lock);
+	return strings.emplace(str).first->c_str();
+}
+
+/**
+ * Finds the index of the token of an error.
+ * @param toks The token table.
+ * @param t The token.
+ * @return The index of the token in the table.
+ */
+static u32 index_of(token_table const& toks, token const& t) {
+	return toks.lower_bound(toks.lines().offset_of(t.start()));
+}
+
+// Reading /////////////////////////////////////////////////////////////////////
+
+std::optional<cache_view> cache_view::open(std::shared_ptr<void const> data,
+	std::size_t size, source const& src, u64 hash) {
+	auto const* bytes = static_cast<u8 const*>(data.get());
+	if (size < sizeof(cache_header) || reinterpret_cast<std::uintptr_t>(bytes) % 8 != 0) {
+		return std::nullopt;
+	}
+	auto view = cache_view(std::move(data));
+	auto const& h = view.header();
+	if (h.magic != cache_magic || h.version != cache_version
+	 || h.hash != hash || h.source_size != src.size() || h.file_size != size) {
+		return std::nullopt;
+	}
+	// Every section has to fit in the file
+	auto fits = [&](u32 offset, u64 count, u64 elem) {
+		return offset % 4 == 0 && offset >= sizeof(cache_header)
+			&& offset + count * elem <= size;
+	};
+	auto errors = u64(h.lexical_error_count) + h.syntax_error_count;
+	if (!fits(h.text, u64(h.source_size) + 1, sizeof(char))
+	 || !fits(h.types, h.token_count, sizeof(u8))
+	 || !fits(h.offsets, h.token_count, sizeof(u32))
+	 || !fits(h.lengths, h.token_count, sizeof(u32))
+	 || !fits(h.names, h.name_count, sizeof(cached_name))
+	 || !fits(h.segments, h.segment_count, sizeof(cached_segment))
+	 || !fits(h.errors, errors, sizeof(cached_error))
+	 || !fits(h.strings, h.string_size, sizeof(char))) {
+		return std::nullopt;
+	}
+	// The hash only names the file, the text decides
+	if (view.text()[h.source_size] != '\0'
+	 || std::memcmp(view.text(), src.data(), src.size()) != 0) {
+		return std::nullopt;
+	}
+	if (h.padding != 0 || checksum_of(bytes, size) != h.checksum || !view.validate()) {
+		return std::nullopt;
+	}
+	return view;
+}
+
+bool cache_view::validate() const {
+	auto const& h = header();
+	// Tokens are in order, inside of the source, and end with the EndOfFile
+	if (h.token_count == 0 || types()[h.token_count - 1] != token::EndOfFile) {
+		return false;
+	}
+	for (u32 i = 0; i < h.name_count; ++i) {
+		auto const& n = names()[i];
+		if (n.length == 0 || u64(n.offset) + n.length > h.source_size) {
+			return false;
+		}
+	}
+	u32 prev = 0;
+	for (u32 i = 0; i < h.token_count; ++i) {
+		auto ty = types()[i];
+		auto off = offsets()[i];
+		auto len = lengths()[i];
+		if (ty == token::Identifier) {
+			if (len >= h.name_count) {
+				return false;
+			}
+			len = names()[len].length;
+		}
+		if (ty > token::Integer || off < prev || u64(off) + len > h.source_size) {
+			return false;
+		}
+		prev = off;
+	}
+
+	// Segments cover the tokens before the EndOfFile, and their nodes refer to
+	// the right kinds of tokens
+	auto is = [&](u32 i, u32 first, u32 end, token::type_t ty) {
+		return i >= first && i < end && types()[i] == ty;
+	};
+	u32 next = 0;
+	u32 decls = 0;
+	u64 syntax_errors = 0;
+	for (u32 i = 0; i < h.segment_count; ++i) {
+		auto const& s = segments()[i];
+		auto end = u64(s.first) + s.count;
+		if (s.first != next || s.count == 0 || end >= h.token_count) {
+			return false;
+		}
+		switch (s.kind) {
+		case cached_segment::None:
+			break;
+
+		case cached_segment::FunctionDef:
+			if (!is(s.lbrace, s.first, u32(end), token::LeftBrace)
+			 || !is(s.rbrace, s.first, u32(end), token::RightBrace)) {
+				return false;
+			}
+			[[fallthrough]];
+
+		case cached_segment::FunctionDecl:
+			if (!is(s.name, s.first, u32(end), token::Identifier)) {
+				return false;
+			}
+			break;
+
+		default:
+			return false;
+		}
+		next = u32(end);
+		decls += (s.kind != cached_segment::None) ? 1 : 0;
+		syntax_errors += s.errors;
+	}
+	if (next != h.token_count - 1 || decls != h.decl_count
+	 || syntax_errors != h.syntax_error_count) {
+		return false;
+	}
+
+	// Strings are terminated, errors refer to existing tokens and strings
+	auto const* strings = section<char>(h.strings);
+	if (h.string_size > 0 && strings[h.string_size - 1] != '\0') {
+		return false;
+	}
+	auto count = h.lexical_error_count + h.syntax_error_count;
+	for (u32 i = 0; i < count; ++i) {
+		auto const& e = errors()[i];
+		bool lexical = i < h.lexical_error_count;
+		switch (e.kind) {
+		case cached_error::UnclosedComment:
+		case cached_error::UnexpectedChar:
+			if (!lexical) {
+				return false;
+			}
+			break;
+
+		case cached_error::UnexpectedToken:
+		case cached_error::ExpectedToken:
+			if (lexical || e.where >= h.token_count
+			 || (e.value != none && e.value >= h.string_size)) {
+				return false;
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+token_table cache_view::tokens(interner& syms) const {
+	auto const& h = header();
+	// Symbol IDs are only valid in the session, the names are interned again
+	auto syms_of = std::vector<symbol>(h.name_count);
+	for (u32 i = 0; i < h.name_count; ++i) {
+		auto const& n = names()[i];
+		syms_of[i] = syms.intern(std::string_view(text() + n.offset, n.length));
+	}
+	return token_table(text(), syms, types(), offsets(), lengths(),
+		h.token_count, std::move(syms_of), m_Data);
+}
+
+err::error_t cache_view::error(u32 i, token_table const& toks) const {
+	auto const& e = errors()[i];
+	auto str = [&]() -> char const* {
+		if (e.value == none) {
+			return nullptr;
+		}
+		return description(section<char>(header().strings) + e.value);
+	};
+	switch (e.kind) {
+	case cached_error::UnclosedComment:
+		return err::unclosed_comment(position::row_col(e.where, e.column), e.value);
+
+	case cached_error::UnexpectedChar:
+		return err::unexpected_char(position::row_col(e.where, e.column), char(e.value));
+
+	case cached_error::UnexpectedToken:
+		return err::unexpected_token(toks[e.where], str());
+
+	case cached_error::ExpectedToken:
+		return err::expected_token(toks[e.where], str());
+	}
+	yk_unreachable;
+	return err::unexpected_token(toks[e.where], str());
+}
+
+std::vector<err::error_t> cache_view::lexical_errors(token_table const& toks) const {
+	auto result = std::vector<err::error_t>();
+	result.reserve(header().lexical_error_count);
+	for (u32 i = 0; i < header().lexical_error_count; ++i) {
+		result.push_back(error(i, toks));
+	}
+	return result;
+}
+
+// Writing /////////////////////////////////////////////////////////////////////
+
+std::vector<u8> serialize(source const& src, token_table const& toks,
+	std::vector<err::error_t> const& lex_errs, compilation_unit const& unit) {
+	auto h = cache_header();
+	std::memset(&h, 0, sizeof(h));
+	h.magic = cache_magic;
+	h.version = cache_version;
+	h.hash = content_hash(src.text());
+	h.source_size = src.size();
+	h.token_count = toks.size();
+	h.segment_count = u32(unit.segments().size());
+	h.decl_count = u32(unit.decl_count());
+	h.lexical_error_count = u32(lex_errs.size());
+	h.syntax_error_count = u32(unit.errors().size());
+
+	auto out = std::vector<u8>(sizeof(cache_header));
+	// Appends a section, aligned to 4 bytes, and returns it's offset
+	auto append = [&](void const* data, std::size_t size) {
+		auto offset = (out.size() + 3) & ~std::size_t(3);
+		out.resize(offset + size);
+		if (size != 0) {
+			std::memcpy(out.data() + offset, data, size);
+		}
+		return u32(offset);
+	};
+
+	h.text = append(src.data(), std::size_t(src.size()) + 1);
+
+	// Identifiers store the index of their name, so only the distinct names
+	// have to be interned when restoring
+	auto offsets = std::vector<u32>(toks.size());
+	auto lengths = std::vector<u32>(toks.size());
+	auto names = std::vector<cached_name>();
+	auto name_index = std::unordered_map<u32, u32>();
+	for (u32 i = 0; i < toks.size(); ++i) {
+		offsets[i] = toks.offset(i);
+		if (toks.type(i) != token::Identifier) {
+			lengths[i] = toks.length(i);
+			continue;
+		}
+		auto it = name_index.emplace(toks.name(i).id(), u32(names.size())).first;
+		if (it->second == names.size()) {
+			names.push_back(cached_name{ toks.offset(i), toks.length(i) });
+		}
+		lengths[i] = it->second;
+	}
+	h.name_count = u32(names.size());
+	h.types = append(toks.types(), toks.size());
+	h.offsets = append(offsets.data(), offsets.size() * sizeof(u32));
+	h.lengths = append(lengths.data(), lengths.size() * sizeof(u32));
+	h.names = append(names.data(), names.size() * sizeof(cached_name));
+
+	auto index = [&](std::optional<range> const& r) {
+		yk_assert(r);
+		return toks.lower_bound(toks.lines().offset_of(r->start()));
+	};
+	auto segments = std::vector<cached_segment>(unit.segments().size());
+	for (std::size_t i = 0; i < segments.size(); ++i) {
+		auto const& seg = unit.segments()[i];
+		auto& s = segments[i];
+		std::memset(&s, 0, sizeof(s));
+		s.first = seg.first;
+		s.count = seg.count;
+		s.errors = seg.errors;
+		s.kind = cached_segment::None;
+		if (!seg.decl) {
+			continue;
+		}
+		match(seg.decl->node)(
+			[&](stmt::fdecl const& d) {
+				s.kind = cached_segment::FunctionDecl;
+				s.name = index(d.name().pos);
+			},
+			[&](stmt::fdef const& d) {
+				s.kind = cached_segment::FunctionDef;
+				s.name = index(d.name().pos);
+				s.lbrace = index(d.body().start_brace());
+				s.rbrace = index(d.body().end_brace());
+			}
+		);
+	}
+	h.segments = append(segments.data(), segments.size() * sizeof(cached_segment));
+
+	// The descriptions are string literals, so they are deduplicated by address
+	auto strings = std::string();
+	auto string_offsets = std::unordered_map<char const*, u32>();
+	auto string = [&](char const* str) {
+		if (!str) {
+			return cache_view::none;
+		}
+		auto it = string_offsets.find(str);
+		if (it != string_offsets.end()) {
+			return it->second;
+		}
+		auto offset = u32(strings.size());
+		strings.append(str);
+		strings.push_back('\0');
+		string_offsets.emplace(str, offset);
+		return offset;
+	};
+	auto errors = std::vector<cached_error>();
+	errors.reserve(lex_errs.size() + unit.errors().size());
+	auto add = [&](cached_error::kind_t kind, u32 where, u32 column, u32 value) {
+		auto e = cached_error();
+		std::memset(&e, 0, sizeof(e));
+		e.kind = kind;
+		e.where = where;
+		e.column = column;
+		e.value = value;
+		errors.push_back(e);
+	};
+	auto add_error = [&](err::error_t const& e) {
+		match(e)(
+			[&](err::unclosed_comment const& x) {
+				add(cached_error::UnclosedComment,
+					x.pos().row(), x.pos().column(), x.depth());
+			},
+			[&](err::unexpected_char const& x) {
+				add(cached_error::UnexpectedChar,
+					x.pos().row(), x.pos().column(), u8(x.character()));
+			},
+			[&](err::unexpected_token const& x) {
+				add(cached_error::UnexpectedToken,
+					index_of(toks, x.tok()), 0, string(x.expected_instead()));
+			},
+			[&](err::expected_token const& x) {
+				add(cached_error::ExpectedToken,
+					index_of(toks, x.got()), 0, string(x.expectation()));
+			}
+		);
+	};
+	for (auto const& e : lex_errs) {
+		add_error(e);
+	}
+	for (auto const& e : unit.errors()) {
+		add_error(e);
+	}
+	h.errors = append(errors.data(), errors.size() * sizeof(cached_error));
+	h.string_size = u32(strings.size());
+	h.strings = append(strings.data(), strings.size());
+
+	out.resize((out.size() + 7) & ~std::size_t(7));
+	h.file_size = u32(out.size());
+	std::memcpy(out.data(), &h, sizeof(h));
+	h.checksum = checksum_of(out.data(), out.size());
+	std::memcpy(out.data(), &h, sizeof(h));
+	return out;
+}
+
+// Files ///////////////////////////////////////////////////////////////////////
+
+parse_cache::parse_cache(std::filesystem::path dir, u64 max_size)
+	: m_Directory(std::move(dir)), m_MaxSize(max_size),
+	m_Usage(std::make_unique<usage>()) {
+}
+
+std::filesystem::path parse_cache::path_of(u64 hash) const {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.ykc", (unsigned long long)hash);
+	return m_Directory / name;
+}
+
+std::optional<cache_view> parse_cache::find(source const& src) const {
+	auto hash = content_hash(src.text());
+	auto path = path_of(hash);
+	auto file = mapped_file::open(path);
+	if (!file) {
+		return std::nullopt;
+	}
+	auto size = file->size();
+	auto shared = std::make_shared<mapped_file>(std::move(*file));
+	auto view = cache_view::open(
+		std::shared_ptr<void const>(shared, shared->data()), size, src, hash);
+	if (view) {
+		// Recently used files are evicted last
+		auto ec = std::error_code();
+		std::filesystem::last_write_time(path,
+			std::filesystem::file_time_type::clock::now(), ec);
+	}
+	return view;
+}
+
+bool parse_cache::store(source const& src, token_table const& toks,
+	std::vector<err::error_t> const& lex_errs,
+	compilation_unit const& unit) const {
+	auto bytes = serialize(src, toks, lex_errs, unit);
+	auto ec = std::error_code();
+	std::filesystem::create_directories(m_Directory, ec);
+	if (ec) {
+		return false;
+	}
+	auto const& h = *reinterpret_cast<cache_header const*>(bytes.data());
+	auto path = path_of(h.hash);
+	auto tmp = path;
+	tmp += "." + std::to_string(
+		std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+	{
+		auto file = std::ofstream(tmp, std::ios::binary | std::ios::trunc);
+		if (!file.write(reinterpret_cast<char const*>(bytes.data()), bytes.size())) {
+			file.close();
+			std::filesystem::remove(tmp, ec);
+			return false;
+		}
+	}
+	std::filesystem::rename(tmp, path, ec);
+	if (ec) {
+		std::filesystem::remove(tmp, ec);
+		return false;
+	}
+
+	auto guard = std::lock_guard<std::mutex>(m_Usage->lock);
+	if (!m_Usage->measured) {
+		// Includes the file just written
+		m_Usage->bytes = evict();
+		m_Usage->measured = true;
+	}
+	else {
+		m_Usage->bytes += bytes.size();
+		if (m_Usage->bytes > m_MaxSize) {
+			m_Usage->bytes = evict();
+		}
+	}
+	return true;
+}
+
+u64 parse_cache::evict() const {
+	struct file_info {
+		std::filesystem::file_time_type time;
+		u64 size;
+		std::filesystem::path path;
+	};
+	auto files = std::vector<file_info>();
+	u64 total = 0;
+	auto ec = std::error_code();
+	for (auto it = std::filesystem::directory_iterator(m_Directory, ec);
+		!ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+		auto const& p = it->path();
+		if (p.extension() != ".ykc") {
+			continue;
+		}
+		auto fec = std::error_code();
+		auto size = it->file_size(fec);
+		auto time = it->last_write_time(fec);
+		if (fec) {
+			continue;
+		}
+		files.push_back(file_info{ time, size, p });
+		total += size;
+	}
+	if (total <= m_MaxSize) {
+		return total;
+	}
+	// Evict down to three quarters of the limit, oldest first
+	auto target = m_MaxSize / 4 * 3;
+	std::sort(files.begin(), files.end(),
+		[](file_info const& a, file_info const& b) { return a.time < b.time; });
+	for (auto const& f : files) {
+		if (total <= target) {
+			break;
+		}
+		// A mapped file stays readable after it's deleted
+		if (std::filesystem::remove(f.path, ec)) {
+			total -= f.size;
+		}
+	}
+	return total;
+}
+
+} /* namespace yk */
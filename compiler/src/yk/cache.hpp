@@ -0,0 +1,287 @@
+/**
+ * cache.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description A binary, memory-mappable format for the parse results of a
+ * source (tokens, AST and errors), so unchanged files don't have to be lexed
+ * and parsed again.
+ */
+
+#ifndef YK_CACHE_HPP
+#define YK_CACHE_HPP
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "common.hpp"
+#include "error.hpp"
+#include "interner.hpp"
+#include "mapped_file.hpp"
+#include "source.hpp"
+#include "token_table.hpp"
+
+namespace yk {
+
+struct compilation_unit;
+
+/**
+ * Hashes a source text. The cache files are named after this hash, but only
+ * trusted after the cached text is compared to the source.
+ * @param text The text to hash.
+ * @return The 64 bit FNV-1a hash of the text.
+ */
+u64 content_hash(std::string_view text);
+
+// The format is a header followed by the sections. Every section is a plain
+// array of fixed-size records, aligned to 4 bytes, so they can be read right
+// from the mapped file. The values are stored in the native byte order, a
+// file written on a machine with a different byte order is rejected by the
+// magic number.
+
+/**
+ * The header of a cache file.
+ */
+struct cache_header {
+	u32 magic;
+	u32 version;
+	u64 hash; // The content hash of the source
+	u32 source_size;
+	u32 token_count;
+	u32 name_count;
+	u32 segment_count;
+	u32 decl_count; // The segments with a node
+	u32 lexical_error_count;
+	u32 syntax_error_count;
+	u32 string_size;
+	// The byte offsets of the sections from the start of the file
+	u32 text; // The source text and a null-terminator
+	u32 types; // u8 for every token
+	u32 offsets; // u32 for every token
+	u32 lengths; // u32 for every token, the name index for identifiers
+	u32 names; // cached_name for every distinct identifier name
+	u32 segments; // cached_segment for every top-level parse step
+	u32 errors; // cached_error for every lexical, then every syntax error
+	u32 strings; // Null-terminated error descriptions
+	u32 file_size;
+	u32 padding; // Zero, so every byte of the header is checked
+	u64 checksum; // The hash of every other byte of the file
+};
+
+/**
+ * A distinct identifier name, by one of it's occurrences in the text. Only
+ * these are interned when the tokens are restored.
+ */
+struct cached_name {
+	u32 offset;
+	u32 length;
+};
+
+/**
+ * A top-level parse step. The node is stored by the indices of the tokens it
+ * was built from.
+ */
+struct cached_segment {
+	enum kind_t : u8 { None, FunctionDecl, FunctionDef };
+
+	u32 first; // The index of the first token
+	u32 count; // The number of consumed tokens
+	u32 name; // The index of the name token
+	u32 lbrace; // The index of the '{' token (definitions only)
+	u32 rbrace; // The index of the '}' token (definitions only)
+	u32 errors; // The number of syntax errors reported
+	kind_t kind;
+	u8 padding[3];
+};
+
+/**
+ * An error. Lexical errors are stored by their positions, syntax errors by the
+ * index of their tokens.
+ */
+struct cached_error {
+	enum kind_t : u8 {
+		UnclosedComment, UnexpectedChar, UnexpectedToken, ExpectedToken
+	};
+
+	kind_t kind;
+	u8 padding[3];
+	u32 where; // The token index, or the row for lexical errors
+	u32 column; // Lexical errors only
+	u32 value; // The comment depth, the character or a string offset
+};
+
+/**
+ * A validated view of a cache file in memory. Nothing is copied, the view
+ * reads the records right from the bytes. The view shares the ownership of the
+ * bytes, so the tables and units restored from it can keep them alive.
+ */
+struct cache_view {
+	// The no-value marker for the optional string offsets
+	static constexpr u32 none = u32(-1);
+
+	/**
+	 * Validates the bytes of a cache file against a source. The cached text is
+	 * compared to the source, and the checksum and every index in the file is
+	 * checked, so a corrupt, outdated or colliding file is rejected instead of
+	 * producing invalid tokens.
+	 * @param data The bytes of the file, aligned to at least 8 bytes.
+	 * @param size The number of bytes.
+	 * @param src The source the file has to belong to.
+	 * @param hash The content hash of the source.
+	 * @return The view, or nullopt if the file is invalid or belongs to a
+	 * different source.
+	 */
+	static std::optional<cache_view> open(std::shared_ptr<void const> data,
+		std::size_t size, source const& src, u64 hash);
+
+	cache_header const& header() const { return *m_Header; }
+
+	char const* text() const { return section<char>(m_Header->text); }
+	u8 const* types() const { return section<u8>(m_Header->types); }
+	u32 const* offsets() const { return section<u32>(m_Header->offsets); }
+	u32 const* lengths() const { return section<u32>(m_Header->lengths); }
+	cached_name const* names() const { return section<cached_name>(m_Header->names); }
+
+	cached_segment const* segments() const {
+		return section<cached_segment>(m_Header->segments);
+	}
+
+	/**
+	 * Returns the errors, the lexical ones first.
+	 * @return The pointer to the first error record.
+	 */
+	cached_error const* errors() const {
+		return section<cached_error>(m_Header->errors);
+	}
+
+	/**
+	 * Restores the token table. The table reads the arrays and the text right
+	 * from the file, only the distinct identifier names are interned.
+	 * @param syms The interner for the identifier names.
+	 * @return The token table, that keeps the file alive.
+	 */
+	token_table tokens(interner& syms) const;
+
+	/**
+	 * Restores an error.
+	 * @param i The index of the error in the error section.
+	 * @param toks The restored token table.
+	 * @return The error.
+	 */
+	err::error_t error(u32 i, token_table const& toks) const;
+
+	/**
+	 * Restores the lexical errors.
+	 * @param toks The restored token table.
+	 * @return The errors, in order.
+	 */
+	std::vector<err::error_t> lexical_errors(token_table const& toks) const;
+
+private:
+	explicit cache_view(std::shared_ptr<void const> data)
+		: m_Data(std::move(data)),
+		m_Header(static_cast<cache_header const*>(m_Data.get())) {
+	}
+
+	template <typename T>
+	T const* section(u32 offset) const {
+		return reinterpret_cast<T const*>(
+			reinterpret_cast<u8 const*>(m_Header) + offset);
+	}
+
+	/**
+	 * Checks that every index and offset in the sections is in bounds.
+	 * @return True, if the records are consistent.
+	 */
+	bool validate() const;
+
+	std::shared_ptr<void const> m_Data;
+	cache_header const* m_Header;
+};
+
+/**
+ * Serializes the parse results of a source.
+ * @param src The source.
+ * @param toks The token table of the source.
+ * @param lex_errs The lexical errors of the source.
+ * @param unit The compilation unit parsed from the token table.
+ * @return The bytes of the cache file.
+ */
+std::vector<u8> serialize(source const& src, token_table const& toks,
+	std::vector<err::error_t> const& lex_errs, compilation_unit const& unit);
+
+/**
+ * A directory of cache files, named after the content hash of their sources.
+ * Since the files are keyed by content, the same cache works for every file
+ * of every workspace. The directory is kept under a size limit by deleting the
+ * least recently used files, a file counts as used when it's found or written.
+ */
+struct parse_cache {
+	// The size limit, when none is given
+	static constexpr u64 default_max_size = u64(256) * 1024 * 1024;
+
+	/**
+	 * Creates a cache in a directory. The directory is created on the first
+	 * store.
+	 * @param dir The path of the directory.
+	 * @param max_size The size limit of the directory in bytes.
+	 */
+	explicit parse_cache(std::filesystem::path dir,
+		u64 max_size = default_max_size);
+
+	/**
+	 * Looks up the cache file of a source.
+	 * @param src The source to look up.
+	 * @return The view of the mapped and validated file, or nullopt if there
+	 * is none. The file is unmapped, when the view and everything restored
+	 * from it is gone.
+	 */
+	std::optional<cache_view> find(source const& src) const;
+
+	/**
+	 * Writes the cache file of a source. The file is written under a temporary
+	 * name and renamed, so readers never see a partial file. When the
+	 * directory grows over the limit, the least recently used files are
+	 * deleted.
+	 * @param src The source.
+	 * @param toks The token table of the source.
+	 * @param lex_errs The lexical errors of the source.
+	 * @param unit The compilation unit parsed from the token table.
+	 * @return True, if the file was written.
+	 */
+	bool store(source const& src, token_table const& toks,
+		std::vector<err::error_t> const& lex_errs,
+		compilation_unit const& unit) const;
+
+private:
+	std::filesystem::path path_of(u64 hash) const;
+
+	/**
+	 * Deletes the least recently used files, until the directory is well
+	 * under the limit, so the next few stores don't have to evict again.
+	 * @return The size of the remaining files.
+	 */
+	u64 evict() const;
+
+	/**
+	 * The known size of the directory, shared by the threads storing into the
+	 * cache. It's measured on the first store, then only the written files are
+	 * added, so not every store has to list the directory.
+	 */
+	struct usage {
+		std::mutex lock;
+		u64 bytes = 0;
+		bool measured = false;
+	};
+
+	std::filesystem::path m_Directory;
+	u64 m_MaxSize;
+	std::unique_ptr<usage> m_Usage;
+};
+
+} /* namespace yk */
+
+#endif /* YK_CACHE_HPP */
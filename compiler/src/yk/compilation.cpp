@@ -0,0 +1,269 @@
+#include <algorithm>
+#include "compilation.hpp"
+#include "parser.hpp"
+
+namespace yk {
+
+// Incremental edits can leave this many replaced declarations in the arena,
+// even in small documents
+static constexpr std::size_t min_garbage = 256;
+
+/**
+ * Moves a syntax error to a different position, and makes it's token refer
+ * into the new source.
+ * @param e The error to move.
+ * @param shift The function that maps the old position to the new one.
+ * @param toks The token table of the new source.
+ * @return The moved error.
+ */
+template <typename Fn>
+static err::error_t relocated(err::error_t const& e, Fn&& shift,
+	token_table const& toks) {
+	auto move = [&](token const& t) {
+		auto r = range(shift(t.start()), shift(t.end()));
+		auto i = toks.lower_bound(toks.lines().offset_of(r.start()));
+		return t.relocated(r, i < toks.size() ? toks.text(i) : std::string_view());
+	};
+	return match(e)(
+		[&](err::unexpected_token const& x) -> err::error_t {
+			return err::unexpected_token(move(x.tok()), x.expected_instead());
+		},
+		[&](err::expected_token const& x) -> err::error_t {
+			return err::expected_token(move(x.got()), x.expectation());
+		},
+		[](auto const& x) -> err::error_t {
+			// Lexical errors are never stored here
+			yk_unreachable;
+			return x;
+		}
+	);
+}
+
+compilation_unit::compilation_unit(std::vector<token> const& toks)
+	: m_Decls(parser::all(toks, m_Nodes)), m_Incremental(false), m_Garbage(0) {
+}
+
+compilation_unit::compilation_unit(std::vector<token> const& toks,
+	thread_pool& pool)
+	: m_Decls(parser::all(toks, m_Nodes, pool)), m_Incremental(false),
+	m_Garbage(0) {
+}
+
+compilation_unit::compilation_unit(token_table const& toks)
+	: m_Decls(arena_allocator<stmt*>(m_Nodes)), m_Incremental(true),
+	m_Garbage(0) {
+	parse_all(toks);
+}
+
+compilation_unit::compilation_unit(token_table const& toks, cache_view const& cached)
+	: m_Decls(arena_allocator<stmt*>(m_Nodes)), m_Incremental(true),
+	m_Garbage(0), m_Cached(cached), m_Restored(toks) {
+	// Only the errors are needed right away
+	auto const& h = cached.header();
+	m_Errors.reserve(h.syntax_error_count);
+	for (u32 i = 0; i < h.syntax_error_count; ++i) {
+		m_Errors.push_back(cached.error(h.lexical_error_count + i, toks));
+	}
+	for (auto const& e : m_Errors) {
+		err::report(err::error_t(e));
+	}
+}
+
+compilation_unit::compilation_unit(lexer& lex)
+	: m_Decls(parser::all(lex, m_Nodes)), m_Incremental(false), m_Garbage(0) {
+}
+
+void compilation_unit::build_restored() const {
+	auto const& toks = *m_Restored;
+	auto const& h = m_Cached->header();
+	m_Segments.reserve(h.segment_count);
+	for (u32 i = 0; i < h.segment_count; ++i) {
+		auto const& s = m_Cached->segments()[i];
+		// The nodes are built from the same tokens, like the parser does
+		stmt* decl = nullptr;
+		switch (s.kind) {
+		case cached_segment::None:
+			break;
+
+		case cached_segment::FunctionDecl:
+			decl = stmt::fdecl::make_stmt(m_Nodes, toks[s.name]);
+			break;
+
+		case cached_segment::FunctionDef:
+			decl = stmt::fdef::make_stmt(m_Nodes, toks[s.name],
+				expr::block::make(toks[s.lbrace], toks[s.rbrace],
+					stmt_list(arena_allocator<stmt*>(m_Nodes)), nullptr));
+			break;
+		}
+		if (decl) {
+			m_Decls.push_back(decl);
+		}
+		m_Segments.push_back(segment{
+			s.first, s.count, toks.position_of(toks.offset(s.first)), decl, s.errors
+		});
+	}
+	m_Restored.reset();
+}
+
+std::size_t compilation_unit::decl_count() const {
+	return m_Restored ? m_Cached->header().decl_count : m_Decls.size();
+}
+
+compilation_unit::segment
+compilation_unit::parse_segment(parser& p, token_table const& toks) {
+	auto first = p.index();
+	auto mark = err::errors().size();
+	auto* decl = p.decl();
+	return segment{
+		first,
+		p.index() - first,
+		toks.position_of(toks.offset(first)),
+		decl,
+		u32(err::errors().size() - mark)
+	};
+}
+
+void compilation_unit::parse_all(token_table const& toks) {
+	m_Segments.clear();
+	m_Errors.clear();
+	m_Garbage = 0;
+	auto mark = err::errors().size();
+	auto p = parser(toks, m_Nodes);
+	while (!p.is_eof()) {
+		auto seg = parse_segment(p, toks);
+		if (seg.decl) {
+			m_Decls.push_back(seg.decl);
+		}
+		m_Segments.push_back(seg);
+	}
+	auto const& errs = err::errors();
+	m_Errors.assign(errs.begin() + mark, errs.end());
+}
+
+void compilation_unit::edit(token_table const& toks, relex_result const& changed) {
+	yk_assert(m_Incremental);
+	// The reused segments are moved from their old positions
+	restore();
+
+	if (m_Garbage > std::max(m_Segments.size(), min_garbage)) {
+		// Free the replaced nodes by starting over
+		m_Decls = stmt_list(arena_allocator<stmt*>(m_Nodes));
+		m_Nodes.clear();
+		parse_all(toks);
+		return;
+	}
+
+	// Keep the segments, that ended before the changed tokens. The token after
+	// a segment could have been peeked, so that has to be unchanged too.
+	auto keep = u32(std::partition_point(
+		m_Segments.begin(), m_Segments.end(),
+		[&](segment const& s) { return s.first + s.count < changed.first; })
+		- m_Segments.begin());
+	u32 keep_decls = 0;
+	u32 keep_errs = 0;
+	for (u32 i = 0; i < keep; ++i) {
+		keep_decls += m_Segments[i].decl ? 1 : 0;
+		keep_errs += m_Segments[i].errors;
+	}
+
+	// Parse until a declaration ends past the changed tokens, exactly where an
+	// old one started. Parsing a declaration only depends on it's tokens, so
+	// from there on every old segment is still valid, only moved.
+	auto new_end = changed.first + changed.inserted;
+	auto delta = i64(changed.inserted) - i64(changed.removed);
+	auto mark = err::errors().size();
+	auto p = parser(toks, m_Nodes, keep > 0
+		? m_Segments[keep - 1].first + m_Segments[keep - 1].count : 0);
+	auto fresh = std::vector<segment>();
+	auto old_idx = keep;
+	auto resync = u32(m_Segments.size());
+	while (!p.is_eof()) {
+		fresh.push_back(parse_segment(p, toks));
+		auto next = p.index();
+		if (next < new_end) {
+			continue;
+		}
+		auto old_next = i64(next) - delta;
+		while (old_idx < m_Segments.size() && m_Segments[old_idx].first < old_next) {
+			++old_idx;
+		}
+		if (old_idx < m_Segments.size() && m_Segments[old_idx].first == old_next) {
+			resync = old_idx;
+			break;
+		}
+	}
+
+	auto const& errs = err::errors();
+	auto fresh_errs = std::vector<err::error_t>(errs.begin() + mark, errs.end());
+	err::truncate(mark);
+
+	u32 dirty_decls = 0;
+	u32 dirty_errs = 0;
+	for (auto i = keep; i < resync; ++i) {
+		dirty_decls += m_Segments[i].decl ? 1 : 0;
+		dirty_errs += m_Segments[i].errors;
+	}
+	m_Garbage += resync - keep;
+
+	// Move the reused segments. Positions on the same row as the first reused
+	// token are shifted in both directions, on later rows only vertically.
+	auto reused_errs = keep_errs + dirty_errs;
+	if (resync < m_Segments.size()) {
+		auto old_sync = m_Segments[resync].start;
+		auto new_sync = toks.position_of(toks.offset(u32(m_Segments[resync].first + delta)));
+		auto shift = [&](position const& pos) {
+			if (pos.row() == old_sync.row()) {
+				return position::row_col(new_sync.row(),
+					pos.column() - old_sync.column() + new_sync.column());
+			}
+			return position::row_col(
+				pos.row() - old_sync.row() + new_sync.row(), pos.column());
+		};
+		// When the row count did not change, only the declarations starting on
+		// the row of the edit move
+		bool same_rows = old_sync.row() == new_sync.row();
+		for (auto i = resync; i < m_Segments.size(); ++i) {
+			auto& seg = m_Segments[i];
+			seg.first = u32(seg.first + delta);
+			if (same_rows && seg.start.row() != old_sync.row()) {
+				continue;
+			}
+			if (seg.decl) {
+				seg.decl->relocate(shift);
+			}
+			seg.start = shift(seg.start);
+		}
+		for (auto i = reused_errs; i < m_Errors.size(); ++i) {
+			m_Errors[i] = relocated(m_Errors[i], shift, toks);
+		}
+	}
+	// The kept errors did not move, but their tokens refer into the old source
+	auto same = [](position const& pos) { return pos; };
+	for (u32 i = 0; i < keep_errs; ++i) {
+		m_Errors[i] = relocated(m_Errors[i], same, toks);
+	}
+
+	// Replace the reparsed spans
+	m_Segments.erase(m_Segments.begin() + keep, m_Segments.begin() + resync);
+	m_Segments.insert(m_Segments.begin() + keep, fresh.begin(), fresh.end());
+	m_Decls.erase(m_Decls.begin() + keep_decls,
+		m_Decls.begin() + keep_decls + dirty_decls);
+	auto fresh_decls = std::vector<stmt*>();
+	for (auto const& seg : fresh) {
+		if (seg.decl) {
+			fresh_decls.push_back(seg.decl);
+		}
+	}
+	m_Decls.insert(m_Decls.begin() + keep_decls,
+		fresh_decls.begin(), fresh_decls.end());
+	m_Errors.erase(m_Errors.begin() + keep_errs, m_Errors.begin() + reused_errs);
+	m_Errors.insert(m_Errors.begin() + keep_errs,
+		std::make_move_iterator(fresh_errs.begin()),
+		std::make_move_iterator(fresh_errs.end()));
+
+	for (auto const& e : m_Errors) {
+		err::report(err::error_t(e));
+	}
+}
+
+} /* namespace yk */
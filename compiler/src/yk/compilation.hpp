@@ -0,0 +1,200 @@
+/**
+ * compilation.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description The result of parsing a single source, owning it's AST.
+ */
+
+#ifndef YK_COMPILATION_HPP
+#define YK_COMPILATION_HPP
+
+#include <optional>
+#include <vector>
+#include "arena.hpp"
+#include "ast.hpp"
+#include "cache.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#include "relexer.hpp"
+#include "token_table.hpp"
+
+namespace yk {
+
+struct parser;
+struct thread_pool;
+
+/**
+ * A parsed source. Every AST node of the compilation is allocated from the
+ * arena of the unit, so the whole tree is freed at once when the unit is
+ * destroyed, without visiting the nodes. The nodes refer to the arena, so the
+ * unit can't be moved. To replace it, destroy the old one before parsing the
+ * new one (like std::optional::emplace does).
+ *
+ * When parsed from a token table, the unit can be updated incrementally after
+ * an edit. Only the top-level declarations that overlap the edit are parsed
+ * again, the rest are reused and moved to their new positions.
+ *
+ * A unit restored from a cache file only reads the errors at first. The
+ * segments and the nodes are built from the file when they are first needed,
+ * so a document that is opened, but never edited or walked, builds none.
+ */
+struct compilation_unit {
+	/**
+	 * The result of a single top-level parse step. Failed steps (that produce
+	 * no node) are recorded too, so the steps cover every token.
+	 */
+	struct segment {
+		u32 first; // The index of the first token
+		u32 count; // The number of consumed tokens
+		position start; // The position of the first token
+		stmt* decl; // Can be nullptr
+		u32 errors; // The number of syntax errors reported
+	};
+
+	/**
+	 * Parses a token vector.
+	 * @param toks The tokens, ending with an EndOfFile token.
+	 */
+	explicit compilation_unit(std::vector<token> const& toks);
+
+	/**
+	 * Parses a token vector in parallel.
+	 * @param toks The tokens, ending with an EndOfFile token.
+	 * @param pool The thread pool to parse on.
+	 */
+	compilation_unit(std::vector<token> const& toks, thread_pool& pool);
+
+	/**
+	 * Parses a token table, remembering the token span of every top-level
+	 * declaration, so the unit can be edited later.
+	 * @param toks The table of tokens, ending with an EndOfFile token.
+	 */
+	explicit compilation_unit(token_table const& toks);
+
+	/**
+	 * Restores a unit from a cache file, without parsing. The result can be
+	 * edited, just like when parsed from the token table. The cached syntax
+	 * errors are reported.
+	 * @param toks The table of tokens, restored from the same cache file. The
+	 * unit keeps a copy, that shares the arrays in the file.
+	 * @param cached The cache file of the source.
+	 */
+	compilation_unit(token_table const& toks, cache_view const& cached);
+
+	/**
+	 * Lexes and parses in a single pass.
+	 * @param lex The lexer to pull the tokens from.
+	 */
+	explicit compilation_unit(lexer& lex);
+
+	compilation_unit(compilation_unit const&) = delete;
+	compilation_unit(compilation_unit&&) = delete;
+	compilation_unit& operator=(compilation_unit const&) = delete;
+	compilation_unit& operator=(compilation_unit&&) = delete;
+
+	/**
+	 * Updates the unit after the tokens were edited. Parsing restarts at the
+	 * first declaration that could see the changed tokens, and stops as soon
+	 * as a declaration ends where an unchanged old one started. From there on
+	 * the old declarations are reused. The replaced nodes are left in the
+	 * arena, when there are more of them than live ones, the whole table is
+	 * parsed again into a cleared arena. When done, every syntax error of the
+	 * new document is reported, just like a full parse would have.
+	 * @param toks The new token table.
+	 * @param changed The span of the changed tokens, as reported by the
+	 * relexer.
+	 */
+	void edit(token_table const& toks, relex_result const& changed);
+
+	/**
+	 * Returns the syntax errors of the source. Only available for units parsed
+	 * from a token table.
+	 * @return The syntax errors, in order.
+	 */
+	std::vector<err::error_t> const& errors() const { return m_Errors; }
+
+	/**
+	 * Returns the global declarations of the source.
+	 * @return The list of declaration nodes.
+	 */
+	stmt_list const& decls() const {
+		restore();
+		return m_Decls;
+	}
+
+	/**
+	 * Returns the number of global declarations, without building the nodes
+	 * of a restored unit.
+	 * @return The number of declarations.
+	 */
+	std::size_t decl_count() const;
+
+	/**
+	 * Returns the top-level parse steps. Only available for units parsed from
+	 * a token table.
+	 * @return The steps, in order.
+	 */
+	std::vector<segment> const& segments() const {
+		restore();
+		return m_Segments;
+	}
+
+	/**
+	 * Returns the arena the nodes are allocated in.
+	 * @return The node arena.
+	 */
+	arena const& nodes() const { return m_Nodes; }
+
+private:
+	/**
+	 * Builds the segments and the nodes of a restored unit, if they are not
+	 * built yet.
+	 */
+	void restore() const {
+		if (m_Restored) {
+			build_restored();
+		}
+	}
+
+	/**
+	 * Builds the segments and the nodes from the records of the cache file,
+	 * the same way the parser would have built them from the tokens.
+	 */
+	void build_restored() const;
+
+	/**
+	 * Parses a whole token table from scratch.
+	 * @param toks The tokens to parse.
+	 */
+	void parse_all(token_table const& toks);
+
+	/**
+	 * Parses the next top-level declaration.
+	 * @param p The parser to parse with.
+	 * @param toks The tokens of the parser.
+	 * @return The description of the parsed step.
+	 */
+	static segment parse_segment(parser& p, token_table const& toks);
+
+	// Declared first, it has to outlive the declaration list. The nodes and
+	// the segments of a restored unit are built lazily, even through the
+	// const getters.
+	mutable arena m_Nodes;
+	mutable stmt_list m_Decls;
+	// Only filled when parsed from a token table
+	bool m_Incremental;
+	mutable std::vector<segment> m_Segments;
+	std::vector<err::error_t> m_Errors;
+	// The number of replaced segments since the last full parse
+	std::size_t m_Garbage;
+	// The file of a restored unit. It's kept, as the restored errors refer
+	// into it's text.
+	std::optional<cache_view> m_Cached;
+	// The tokens of a restored unit, until the nodes are built from them
+	mutable std::optional<token_table> m_Restored;
+};
+
+} /* namespace yk */
+
+#endif /* YK_COMPILATION_HPP */
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include "cache.hpp"
+#include "compilation.hpp"
+#include "driver.hpp"
+#include "error.hpp"
+#include "interner.hpp"
+#include "lexer.hpp"
+#include "mapped_file.hpp"
+#include "profile.hpp"
+#include "source.hpp"
+#include "thread_pool.hpp"
+#include "token_table.hpp"
+
+namespace yk {
+
+namespace fs = std::filesystem;
+
+// Input expansion /////////////////////////////////////////////////////////////
+
+/**
+ * Checks if a path matches a glob pattern. '*' and '?' don't match the
+ * directory separator, '**' matches any number of directories.
+ * @param pat The pattern, with '/' separators.
+ * @param str The path, with '/' separators.
+ * @return True, if the path matches.
+ */
+static bool glob_match(std::string_view pat, std::string_view str) {
+	while (!pat.empty()) {
+		if (pat.substr(0, 2) == "**") {
+			auto rest = pat.substr(2);
+			bool dirs = !rest.empty() && rest[0] == '/';
+			if (dirs) {
+				rest = rest.substr(1);
+			}
+			for (std::size_t i = 0; i <= str.size(); ++i) {
+				// "**/" only matches whole directories
+				if (dirs && i > 0 && str[i - 1] != '/') {
+					continue;
+				}
+				if (glob_match(rest, str.substr(i))) {
+					return true;
+				}
+			}
+			return false;
+		}
+		if (pat[0] == '*') {
+			for (std::size_t i = 0; i <= str.size(); ++i) {
+				if (glob_match(pat.substr(1), str.substr(i))) {
+					return true;
+				}
+				if (i < str.size() && str[i] == '/') {
+					break;
+				}
+			}
+			return false;
+		}
+		if (str.empty() || (str[0] == '/' && pat[0] != '/')) {
+			return false;
+		}
+		if (pat[0] != '?' && pat[0] != str[0]) {
+			return false;
+		}
+		pat = pat.substr(1);
+		str = str.substr(1);
+	}
+	return str.empty();
+}
+
+static bool is_pattern(std::string_view str) {
+	return str.find_first_of("*?") != std::string_view::npos;
+}
+
+/**
+ * Collects the files of a directory, that match a predicate.
+ * @param dir The directory to walk recursively.
+ * @param pred The predicate, that gets the path relative to the directory.
+ * @return The sorted matching files.
+ */
+template <typename Pred>
+static std::vector<fs::path> walk(fs::path const& dir, Pred&& pred) {
+	auto result = std::vector<fs::path>();
+	auto ec = std::error_code();
+	auto it = fs::recursive_directory_iterator(dir,
+		fs::directory_options::skip_permission_denied, ec);
+	for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+		if (it->is_regular_file(ec) && pred(it->path().lexically_relative(dir))) {
+			result.push_back(it->path());
+		}
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+/**
+ * Expands a glob pattern. The walk starts at the longest directory prefix
+ * without wildcards.
+ * @param pattern The pattern.
+ * @return The sorted matching files.
+ */
+static std::vector<fs::path> expand_pattern(std::string const& pattern) {
+	auto generic = fs::path(pattern).generic_string();
+	auto base = fs::path();
+	auto rest = std::string_view(generic);
+	while (true) {
+		auto slash = rest.find('/');
+		if (slash == std::string_view::npos || is_pattern(rest.substr(0, slash))) {
+			break;
+		}
+		// Keep the root of absolute paths
+		base /= (slash == 0) ? fs::path("/") : fs::path(rest.substr(0, slash));
+		rest = rest.substr(slash + 1);
+	}
+	return walk(base.empty() ? fs::path(".") : base, [&](fs::path const& rel) {
+		return glob_match(rest, rel.generic_string());
+	});
+}
+
+std::optional<std::vector<fs::path>>
+expand_inputs(std::vector<std::string> const& inputs, std::ostream& diag) {
+	auto result = std::vector<fs::path>();
+	auto seen = std::set<fs::path>();
+	bool ok = true;
+	auto add = [&](fs::path const& p) {
+		if (seen.insert(p.lexically_normal()).second) {
+			result.push_back(p);
+		}
+	};
+	// File lists are expanded in place, without recursion
+	auto expand = [&](std::string const& input) {
+		auto ec = std::error_code();
+		auto found = std::vector<fs::path>();
+		if (is_pattern(input)) {
+			found = expand_pattern(input);
+		}
+		else if (fs::is_directory(input, ec)) {
+			found = walk(input, [](fs::path const& rel) {
+				return rel.extension() == ".yk";
+			});
+		}
+		else if (fs::exists(input, ec)) {
+			found.push_back(input);
+		}
+		if (found.empty() && !fs::is_directory(input, ec)) {
+			diag << "yk: no such file: " << input << '\n';
+			ok = false;
+		}
+		for (auto const& p : found) {
+			add(p);
+		}
+	};
+	for (auto const& input : inputs) {
+		if (input.empty() || input[0] != '@') {
+			expand(input);
+			continue;
+		}
+		auto list = std::ifstream(input.substr(1));
+		if (!list) {
+			diag << "yk: can't read file list: " << input.substr(1) << '\n';
+			ok = false;
+			continue;
+		}
+		auto line = std::string();
+		while (std::getline(list, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (!line.empty()) {
+				expand(line);
+			}
+		}
+	}
+	if (!ok) {
+		return std::nullopt;
+	}
+	return result;
+}
+
+// Compilation /////////////////////////////////////////////////////////////////
+
+/**
+ * The result of compiling a single file.
+ */
+struct file_result {
+	std::string output; // The formatted diagnostics
+	u64 bytes = 0;
+	u64 tokens = 0;
+	u64 decls = 0;
+	u64 errors = 0;
+	bool cached = false;
+	bool unreadable = false;
+	phase_profile phases;
+};
+
+// From this size on a file is lexed and parsed in parallel, when there's no
+// cache to store it in. Below this, splitting it costs more than it saves.
+static constexpr u32 parallel_size = 1u << 20;
+
+/**
+ * Lexes and parses a file, or restores it from the cache.
+ * @param path The path of the file.
+ * @param cache The cache, nullptr to compile without one.
+ * @param pool The thread pool to split a large file on, nullptr to compile
+ * every file on a single thread.
+ * @param profile True, if the phases are reported in the output.
+ * @return The result of the compilation.
+ */
+static file_result compile_file(fs::path const& path, parse_cache const* cache,
+	thread_pool* pool, bool profile) {
+	auto result = file_result();
+	auto& phases = result.phases;
+	auto name = path.generic_string();
+	auto src = source();
+	measure(phases, phase::Read, [&] {
+		// The text is lexed right from the mapping, there's no copy
+		if (auto file = mapped_file::open(path, true)) {
+			src = source(std::move(*file));
+		}
+		else {
+			result.unreadable = true;
+		}
+	});
+	if (result.unreadable) {
+		result.output = name + ": error: can't read the file\n";
+		return result;
+	}
+
+	// Symbols are not shared between files, every file has it's own interner
+	auto syms = interner();
+	auto errs = err::sink();
+	auto install = err::scoped_sink(errs);
+	auto cached = std::optional<cache_view>();
+	auto toks = std::optional<token_table>();
+	auto unit = std::optional<compilation_unit>();
+	if (cache) {
+		measure(phases, phase::Cache, [&] { cached = cache->find(src); });
+	}
+	if (cached) {
+		measure(phases, phase::Lex, [&] {
+			toks.emplace(cached->tokens(syms));
+			for (auto& e : cached->lexical_errors(*toks)) {
+				err::report(std::move(e));
+			}
+		});
+		result.tokens = toks->size();
+		measure(phases, phase::Parse, [&] { unit.emplace(*toks, *cached); });
+		result.cached = true;
+	}
+	else if (!cache && pool && src.size() >= parallel_size) {
+		// The chunks are processed by the idle workers, the rest of the
+		// batch is not held up. The unit can't be edited or stored, but the
+		// CLI only needs the diagnostics.
+		auto tok_vec = std::vector<token>();
+		measure(phases, phase::Lex, [&] { tok_vec = lexer::all(src, syms, *pool); });
+		measure(phases, phase::Parse, [&] { unit.emplace(tok_vec, *pool); });
+		result.tokens = tok_vec.size();
+	}
+	else {
+		measure(phases, phase::Lex, [&] { toks.emplace(token_table::lex(src, syms)); });
+		auto lex_errs = errs.errors();
+		measure(phases, phase::Parse, [&] { unit.emplace(*toks); });
+		result.tokens = toks->size();
+		if (cache) {
+			measure(phases, phase::Cache, [&] {
+				cache->store(src, *toks, lex_errs, *unit);
+			});
+		}
+	}
+
+	measure(phases, phase::Diagnostics, [&] {
+		for (auto const& e : errs.errors()) {
+			auto start = err::error_range(e).start();
+			result.output += name + ':' + std::to_string(start.row() + 1) + ':'
+				+ std::to_string(start.column() + 1) + ": error: "
+				+ err::message(e) + '\n';
+		}
+	});
+	if (profile) {
+		auto line = std::ostringstream();
+		line << name << ": profile: ";
+		write_profile_line(line, phases);
+		result.output += line.str() + '\n';
+	}
+	result.bytes = src.size();
+	result.decls = unit->decl_count();
+	result.errors = errs.errors().size();
+	return result;
+}
+
+batch_summary compile_batch(std::vector<fs::path> const& files,
+	driver_options const& opts, std::ostream& out) {
+	auto start = std::chrono::steady_clock::now();
+	auto n = u32(files.size());
+	auto cache = std::optional<parse_cache>();
+	if (opts.cache) {
+		cache.emplace(*opts.cache);
+	}
+
+	// Largest first, the small files fill the gaps at the end
+	auto order = std::vector<u32>(n);
+	auto sizes = std::vector<std::uintmax_t>(n);
+	for (u32 i = 0; i < n; ++i) {
+		auto ec = std::error_code();
+		order[i] = i;
+		sizes[i] = fs::file_size(files[i], ec);
+		if (ec) {
+			sizes[i] = 0;
+		}
+	}
+	std::stable_sort(order.begin(), order.end(),
+		[&](u32 a, u32 b) { return sizes[a] > sizes[b]; });
+
+	// The calling thread works too. A single file still gets the pool, it
+	// might be large enough to split.
+	auto threads = opts.jobs ? opts.jobs : std::max(1u, std::thread::hardware_concurrency());
+	auto pool = std::optional<thread_pool>();
+	if (threads > 1) {
+		pool.emplace(threads - 1);
+	}
+
+	auto summary = batch_summary();
+	summary.files = n;
+	auto lock = std::mutex();
+	auto results = std::vector<std::optional<file_result>>(n);
+	u32 next = 0;
+	auto run = [&](u32 k) {
+		auto i = order[k];
+		auto res = compile_file(files[i], cache ? &*cache : nullptr,
+			pool ? &*pool : nullptr, opts.profile);
+		auto guard = std::lock_guard<std::mutex>(lock);
+		results[i] = std::move(res);
+		// Write out every finished file, that has no unfinished file before it
+		while (next < n && results[next]) {
+			auto& r = *results[next];
+			out << r.output;
+			summary.cached += r.cached ? 1 : 0;
+			summary.unreadable += r.unreadable ? 1 : 0;
+			summary.bytes += r.bytes;
+			summary.tokens += r.tokens;
+			summary.decls += r.decls;
+			summary.errors += r.errors;
+			for (std::size_t p = 0; p < phase_count; ++p) {
+				summary.phases[p].add(r.phases[p]);
+			}
+			if (opts.profile) {
+				summary.profiles.push_back(r.phases);
+			}
+			results[next].reset();
+			++next;
+		}
+	};
+
+	if (n <= 1 || !pool) {
+		for (u32 k = 0; k < n; ++k) {
+			run(k);
+		}
+	}
+	else {
+		pool->for_each(n, run);
+	}
+	out.flush();
+
+	summary.seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	return summary;
+}
+
+} /* namespace yk */
@@ -0,0 +1,82 @@
+/**
+ * driver.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description The batch driver of the command line compiler, that compiles
+ * many files in parallel.
+ */
+
+#ifndef YK_DRIVER_HPP
+#define YK_DRIVER_HPP
+
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "common.hpp"
+#include "profile.hpp"
+
+namespace yk {
+
+/**
+ * The settings of a batch compilation.
+ */
+struct driver_options {
+	u32 jobs = 0; // The number of threads, 0 for the hardware threads
+	// The directory of the parse cache, nullopt to compile everything
+	std::optional<std::filesystem::path> cache;
+	// Report the cost of every phase for every file
+	bool profile = false;
+};
+
+/**
+ * The totals of a batch compilation.
+ */
+struct batch_summary {
+	u32 files = 0;
+	u32 cached = 0; // Files restored from the cache
+	u32 unreadable = 0;
+	u64 bytes = 0;
+	u64 tokens = 0;
+	u64 decls = 0;
+	u64 errors = 0;
+	double seconds = 0.0;
+	phase_profile phases; // Summed over the files
+	std::vector<phase_profile> profiles; // Per file, only when profiling
+};
+
+/**
+ * Expands the inputs of the command line into a list of files. An input can
+ * be a file, a directory (every .yk file under it), a glob pattern (with '*',
+ * '?' and '**' for any number of directories) or a file list in the form of
+ * @path, with one input per line. The files of a directory or a pattern are
+ * sorted, so the result does not depend on the file system. Every file is
+ * listed once, in the order of the first mention.
+ * @param inputs The inputs.
+ * @param diag The stream to report the inputs that match nothing.
+ * @return The files, or nullopt if an input matched nothing.
+ */
+std::optional<std::vector<std::filesystem::path>>
+expand_inputs(std::vector<std::string> const& inputs, std::ostream& diag);
+
+/**
+ * Compiles files on a thread pool. The inputs are memory-mapped and handed
+ * out largest first, so a big file doesn't end up last on a single thread.
+ * The diagnostics are written in the order of the files, each file as soon as
+ * every file before it is done, so the output is the same on every run.
+ * Without a cache, a file of at least a megabyte is lexed and parsed in
+ * parallel on the same pool, as the workers become free.
+ * When profiling, every file ends with a line of the costs of it's phases.
+ * @param files The files to compile.
+ * @param opts The settings.
+ * @param out The stream to write the diagnostics to.
+ * @return The totals.
+ */
+batch_summary compile_batch(std::vector<std::filesystem::path> const& files,
+	driver_options const& opts, std::ostream& out);
+
+} /* namespace yk */
+
+#endif /* YK_DRIVER_HPP */
@@ -3,22 +3,74 @@
 namespace yk {
 namespace err {
 
-static std::vector<error_t> error_list;
+// Every thread has it's own default sink, so threads lexing or parsing in
+// parallel don't interfere with each other
+static thread_local sink default_sink;
+static thread_local sink* current_sink = nullptr;
+
+std::string message(error_t const& err) {
+	return match(err)(
+		[](unclosed_comment const& e) {
+			return "Unclosed comment with nesting " + std::to_string(e.depth());
+		},
+		[](unexpected_char const& e) {
+			return std::string("Unexpected character '") + e.character()
+				+ "' (code: " + std::to_string(e.character_code()) + ")";
+		},
+		[](unexpected_token const& e) {
+			auto msg = std::string("Unexpected token!");
+			if (e.expected_instead()) {
+				msg += std::string(" In this context ") + e.expected_instead() + " is expected!";
+			}
+			return msg;
+		},
+		[](expected_token const& e) {
+			return std::string("Unexpected token, expected ") + e.expectation() + " instead!";
+		}
+	);
+}
+
+range error_range(error_t const& err) {
+	return std::visit([](auto const& e) { return e.err_range(); }, err);
+}
+
+void sink::truncate(std::size_t n) {
+	if (n < m_Errors.size()) {
+		m_Errors.erase(m_Errors.begin() + n, m_Errors.end());
+	}
+}
+
+scoped_sink::scoped_sink(sink& s)
+	: m_Previous(current_sink) {
+	current_sink = &s;
+}
+
+scoped_sink::~scoped_sink() {
+	current_sink = m_Previous;
+}
+
+sink& current() {
+	return current_sink ? *current_sink : default_sink;
+}
 
 void init() {
-	error_list = std::vector<error_t>();
+	current() = sink();
 }
 
 void clear() {
-	error_list.clear();
+	current().clear();
+}
+
+void truncate(std::size_t n) {
+	current().truncate(n);
 }
 
 void report(error_t&& err) {
-	error_list.push_back(std::move(err));
+	current().report(std::move(err));
 }
 
 std::vector<error_t> const& errors() {
-	return error_list;
+	return current().errors();
 }
 
 } /* namespace err */
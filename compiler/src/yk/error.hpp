@@ -10,6 +10,7 @@
 #ifndef YK_ERROR_HPP
 #define YK_ERROR_HPP
 
+#include <string>
 #include <variant>
 #include <vector>
 #include "common.hpp"
@@ -124,6 +125,80 @@ using error_t = std::variant<
 	expected_token
 >;
 
+/**
+ * Creates the human-readable message of an error.
+ * @param err The error.
+ * @return The message, without the position.
+ */
+std::string message(error_t const& err);
+
+/**
+ * Returns the range of the source an error refers to.
+ * @param err The error.
+ * @return The range of the error.
+ */
+range error_range(error_t const& err);
+
+/**
+ * A list of reported errors, the diagnostic context of a compilation. Every
+ * thread has a current sink, where the functions of this module report to.
+ * By default it's a per-thread sink, but a compilation can install it's own
+ * one with scoped_sink, so it's errors don't mix with other compilations.
+ */
+struct sink {
+	/**
+	 * Reports an error.
+	 * @param err The error to report.
+	 */
+	void report(error_t&& err) { m_Errors.push_back(std::move(err)); }
+
+	/**
+	 * Clears the error list.
+	 */
+	void clear() { m_Errors.clear(); }
+
+	/**
+	 * Removes the errors reported after the first n errors.
+	 * @param n The number of errors to keep.
+	 */
+	void truncate(std::size_t n);
+
+	std::vector<error_t> const& errors() const { return m_Errors; }
+
+private:
+	std::vector<error_t> m_Errors;
+};
+
+/**
+ * Installs a sink as the current sink of the thread, until the object goes
+ * out of scope. Then the previous sink is restored, so installations can be
+ * nested.
+ */
+struct scoped_sink {
+	/**
+	 * Installs a sink.
+	 * @param s The sink to report to on this thread.
+	 */
+	explicit scoped_sink(sink& s);
+
+	scoped_sink(scoped_sink const&) = delete;
+	scoped_sink& operator=(scoped_sink const&) = delete;
+
+	~scoped_sink();
+
+private:
+	sink* m_Previous;
+};
+
+/**
+ * Returns the current sink of the calling thread.
+ * @return The installed sink, or the default sink of the thread.
+ */
+sink& current();
+
+// Note: The functions below work with the current sink of the calling thread.
+// Errors reported on one thread are only visible on that same thread.
+
 /**
  * Initializes the error interface for usage.
  */
@@ -134,6 +209,12 @@ void init();
  */
 void clear();
 
+/**
+ * Removes the errors reported after the first n errors.
+ * @param n The number of errors to keep.
+ */
+void truncate(std::size_t n);
+
 /**
  * Reports an error.
  * @param err The error to report.
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstring>
+#include "interner.hpp"
+
+namespace yk {
+
+// The size of a single storage block for the strings
+static constexpr std::size_t block_size = 4096;
+// The initial number of hash table slots, must be a power of 2
+static constexpr std::size_t initial_slots = 256;
+
+interner::interner()
+	: m_Slots(initial_slots, 0), m_BlockPtr(nullptr), m_BlockLeft(0) {
+}
+
+u32 interner::hash(std::string_view str) {
+	// Word-at-a-time multiplicative hash. Names are short, so this is usually
+	// one or two rounds instead of a round per character.
+	constexpr u64 k = 0x9e3779b97f4a7c15ull;
+	u64 h = u64(str.size()) * k;
+	auto const* p = str.data();
+	auto n = str.size();
+	while (n >= 8) {
+		u64 w;
+		std::memcpy(&w, p, 8);
+		h = (h ^ w) * k;
+		h ^= h >> 29;
+		p += 8;
+		n -= 8;
+	}
+	if (n > 0) {
+		u64 w = 0;
+		std::memcpy(&w, p, n);
+		h = (h ^ w) * k;
+		h ^= h >> 29;
+	}
+	return u32(h ^ (h >> 32));
+}
+
+symbol interner::intern(std::string_view str) {
+	auto h = hash(str);
+	auto mask = m_Slots.size() - 1;
+	for (auto i = h & mask;; i = (i + 1) & mask) {
+		auto slot = m_Slots[i];
+		if (slot == 0) {
+			// Not found, insert
+			auto id = u32(m_Strings.size());
+			m_Strings.push_back(store(str));
+			m_Hashes.push_back(h);
+			m_Slots[i] = id + 1;
+			// Keep the load factor under 1/2
+			if (m_Strings.size() * 2 > m_Slots.size()) {
+				grow();
+			}
+			return symbol(id);
+		}
+		auto id = slot - 1;
+		if (m_Hashes[id] == h && m_Strings[id] == str) {
+			return symbol(id);
+		}
+	}
+}
+
+symbol interner::find(std::string_view str) const {
+	auto h = hash(str);
+	auto mask = m_Slots.size() - 1;
+	for (auto i = h & mask;; i = (i + 1) & mask) {
+		auto slot = m_Slots[i];
+		if (slot == 0) {
+			return symbol();
+		}
+		auto id = slot - 1;
+		if (m_Hashes[id] == h && m_Strings[id] == str) {
+			return symbol(id);
+		}
+	}
+}
+
+std::string_view interner::store(std::string_view str) {
+	if (str.empty()) {
+		return std::string_view();
+	}
+	if (str.size() > m_BlockLeft) {
+		auto size = std::max(block_size, str.size());
+		m_Blocks.push_back(std::make_unique<char[]>(size));
+		m_BlockPtr = m_Blocks.back().get();
+		m_BlockLeft = size;
+	}
+	std::memcpy(m_BlockPtr, str.data(), str.size());
+	auto result = std::string_view(m_BlockPtr, str.size());
+	m_BlockPtr += str.size();
+	m_BlockLeft -= str.size();
+	return result;
+}
+
+void interner::grow() {
+	auto slots = std::vector<u32>(m_Slots.size() * 2, 0);
+	auto mask = slots.size() - 1;
+	for (u32 id = 0; id < m_Strings.size(); ++id) {
+		auto i = m_Hashes[id] & mask;
+		while (slots[i] != 0) {
+			i = (i + 1) & mask;
+		}
+		slots[i] = id + 1;
+	}
+	m_Slots = std::move(slots);
+}
+
+} /* namespace yk */
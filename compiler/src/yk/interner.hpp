@@ -0,0 +1,132 @@
+/**
+ * interner.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description String interning, so names can be stored and compared as
+ * compact integer identifiers.
+ */
+
+#ifndef YK_INTERNER_HPP
+#define YK_INTERNER_HPP
+
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "common.hpp"
+
+namespace yk {
+
+/**
+ * A compact handle for an interned string. Two symbols from the same interner
+ * are equal exactly when their strings are equal.
+ */
+struct symbol {
+	/**
+	 * Creates an invalid symbol, that refers to no string.
+	 */
+	constexpr symbol()
+		: m_ID(invalid_id) {
+	}
+
+	/**
+	 * Creates a symbol from it's raw identifier.
+	 * @param id The identifier of the symbol in it's interner.
+	 */
+	constexpr explicit symbol(u32 id)
+		: m_ID(id) {
+	}
+
+	constexpr u32 id() const { return m_ID; }
+	constexpr bool is_valid() const { return m_ID != invalid_id; }
+
+private:
+	static constexpr u32 invalid_id = u32(-1);
+
+	u32 m_ID;
+};
+
+constexpr bool operator==(symbol a, symbol b) { return a.id() == b.id(); }
+constexpr bool operator!=(symbol a, symbol b) { return a.id() != b.id(); }
+constexpr bool operator<(symbol a, symbol b) { return a.id() < b.id(); }
+
+/**
+ * The table that maps strings to symbols and back. The strings are copied
+ * into large blocks, so the interner does one allocation per block instead of
+ * one per string, and the views it hands out stay valid for it's lifetime.
+ */
+struct interner {
+	interner();
+
+	interner(interner const&) = delete;
+	interner(interner&&) = default;
+	interner& operator=(interner const&) = delete;
+	interner& operator=(interner&&) = default;
+
+	/**
+	 * Interns a string.
+	 * @param str The string to intern.
+	 * @return The symbol of the string. Interning the same string again returns
+	 * the same symbol.
+	 */
+	symbol intern(std::string_view str);
+
+	/**
+	 * Looks up a string without interning it.
+	 * @param str The string to look up.
+	 * @return The symbol of the string, or an invalid symbol if the string was
+	 * never interned.
+	 */
+	symbol find(std::string_view str) const;
+
+	/**
+	 * Retrieves the string of a symbol.
+	 * @param sym The symbol to get the string of. Must be valid and from this
+	 * interner.
+	 * @return The interned string.
+	 */
+	std::string_view str(symbol sym) const {
+		yk_assert(sym.id() < m_Strings.size());
+		return m_Strings[sym.id()];
+	}
+
+	/**
+	 * Returns the number of interned strings.
+	 * @return The number of distinct symbols so far.
+	 */
+	u32 size() const { return u32(m_Strings.size()); }
+
+	/**
+	 * The hash function used by the table.
+	 * @param str The string to hash.
+	 * @return The 32-bit hash of the string.
+	 */
+	static u32 hash(std::string_view str);
+
+private:
+	/**
+	 * Copies a string into the block storage.
+	 * @param str The string to copy.
+	 * @return A view of the stored copy.
+	 */
+	std::string_view store(std::string_view str);
+
+	/**
+	 * Doubles the size of the hash table and re-inserts every symbol.
+	 */
+	void grow();
+
+	// The stored strings and their hashes, indexed by symbol id
+	std::vector<std::string_view> m_Strings;
+	std::vector<u32> m_Hashes;
+	// Open addressing table of (symbol id + 1), 0 marks an empty slot
+	std::vector<u32> m_Slots;
+	// Block storage of the strings
+	std::vector<std::unique_ptr<char[]>> m_Blocks;
+	char* m_BlockPtr;
+	std::size_t m_BlockLeft;
+};
+
+} /* namespace yk */
+
+#endif /* YK_INTERNER_HPP */
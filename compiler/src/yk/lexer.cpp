@@ -1,7 +1,14 @@
+#include <algorithm>
+#include <array>
 #include <cctype>
 #include <cstring>
+#include <iterator>
+#include <optional>
 #include "error.hpp"
 #include "lexer.hpp"
+#include "line_index.hpp"
+#include "scan.hpp"
+#include "thread_pool.hpp"
 
 namespace yk {
 
@@ -63,7 +70,7 @@ bool operator>=(range const& a, range const& b) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-static u32 calculate_length(token::type_t ty, std::string const& val) {
+static u32 calculate_length(token::type_t ty, std::string_view text) {
 	switch (ty) {
 	case token::EndOfFile:
 		return 0;
@@ -76,15 +83,15 @@ static u32 calculate_length(token::type_t ty, std::string const& val) {
 	case token::Semicolon:
 		return 1;
 
-	case token::Keyword_Fn:
-		return 2;
-
-	case token::Keyword_Foreign:
-		return 7;
+#define YK_KEYWORD_LENGTH(name, text) \
+	case token::Keyword_##name: \
+		return sizeof(text) - 1;
+	YK_KEYWORDS(YK_KEYWORD_LENGTH)
+#undef YK_KEYWORD_LENGTH
 
 	case token::Identifier:
 	case token::Integer:
-		return val.length();
+		return u32(text.length());
 
 	case token::LineComment:
 	case token::NestedComment:
@@ -95,17 +102,17 @@ static u32 calculate_length(token::type_t ty, std::string const& val) {
 }
 
 range
-token::calculate_range(position const& pos, type_t ty, std::string const& val) {
+token::calculate_range(position const& pos, type_t ty, std::string_view text) {
 	auto pos2 = pos;
-	pos2.advance(calculate_length(ty, val));
+	pos2.advance(calculate_length(ty, text));
 	return range(pos, pos2);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-std::vector<token> lexer::all(char const* src) {
+std::vector<token> lexer::all(char const* src, interner& syms) {
 	auto result = std::vector<token>();
-	auto lex = lexer(src);
+	auto lex = lexer(src, syms);
 	while (true) {
 		result.push_back(lex.next());
 		if (result.back().type() == token::EndOfFile) {
@@ -114,9 +121,27 @@ std::vector<token> lexer::all(char const* src) {
 	}
 }
 
+std::vector<token> lexer::all(source const& src, interner& syms) {
+	return all(src.data(), syms);
+}
+
+lexer::lexer(line_index const& lines, interner& syms)
+	: m_Source(lines.text()), m_Position(position::zero()), m_Symbols(&syms),
+	m_Lines(&lines) {
+}
+
 void lexer::advance(u32 n) {
 	m_Source += n;
-	m_Position.advance(n);
+	if (!m_Lines) {
+		m_Position.advance(n);
+	}
+}
+
+position lexer::current_position() const {
+	if (m_Lines) {
+		return m_Lines->position_of(u32(m_Source - m_Lines->text()));
+	}
+	return m_Position;
 }
 
 bool lexer::is_eof() const {
@@ -127,7 +152,9 @@ bool lexer::parse_newline() {
 	if (m_Source[0] == '\n') {
 		// UNIX-style newline
 		++m_Source;
-		m_Position.newline();
+		if (!m_Lines) {
+			m_Position.newline();
+		}
 		return true;
 	}
 	else if (m_Source[0] == '\r') {
@@ -139,7 +166,9 @@ bool lexer::parse_newline() {
 			// OS-X 9-style newline
 			++m_Source;
 		}
-		m_Position.newline();
+		if (!m_Lines) {
+			m_Position.newline();
+		}
 		return true;
 	}
 	else {
@@ -148,17 +177,118 @@ bool lexer::parse_newline() {
 }
 
 token lexer::make_simple(token::type_t ty, u32 len) {
-	auto tok = token(m_Position, ty);
+	auto tok = token(m_Position, ty, std::string_view(m_Source, len));
 	advance(len);
 	return tok;
 }
 
 token lexer::make_textual(token::type_t ty, u32 len) {
-	auto tok = token(m_Position, ty, std::string(m_Source, len));
+	auto tok = token(m_Position, ty, std::string_view(m_Source, len));
 	advance(len);
 	return tok;
 }
 
+token lexer::make_identifier(u32 len) {
+	auto text = std::string_view(m_Source, len);
+	auto tok = token(m_Position, text, m_Symbols->intern(text));
+	advance(len);
+	return tok;
+}
+
+// Keywords ////////////////////////////////////////////////////////////////////
+
+struct keyword {
+	std::string_view text;
+	token::type_t type;
+};
+
+static constexpr keyword keyword_list[] = {
+#define YK_KEYWORD_ENTRY(name, text) { text, token::Keyword_##name },
+	YK_KEYWORDS(YK_KEYWORD_ENTRY)
+#undef YK_KEYWORD_ENTRY
+};
+
+static constexpr u32 keyword_count = u32(std::size(keyword_list));
+
+/**
+ * The number of slots in the keyword table, the smallest power of two that is
+ * at least twice the number of keywords.
+ */
+static constexpr u32 keyword_slot_count = [] {
+	u32 n = 1;
+	while (n < 2 * keyword_count) {
+		n *= 2;
+	}
+	return n;
+}();
+
+/**
+ * Hashes a word for the keyword table. Only looks at the length and the first
+ * and last characters, so it's independent of the word length.
+ * @param seed The multiplier, that is searched at compile time.
+ * @param text The word to hash.
+ * @return The slot index of the word.
+ */
+static constexpr u32 keyword_hash(u32 seed, std::string_view text) {
+	auto key = (u32(u8(text.front())) << 16)
+		| (u32(u8(text.back())) << 8)
+		| u32(text.size());
+	return ((key * seed) >> 16) & (keyword_slot_count - 1);
+}
+
+/**
+ * Finds a hash seed, where no two keywords land in the same slot.
+ * @return The seed, or 0 if there is none.
+ */
+static constexpr u32 find_keyword_seed() {
+	for (u32 seed = 1; seed < 100000; seed += 2) {
+		bool unique = true;
+		for (u32 i = 0; i < keyword_count && unique; ++i) {
+			for (u32 j = i + 1; j < keyword_count; ++j) {
+				if (keyword_hash(seed, keyword_list[i].text)
+					== keyword_hash(seed, keyword_list[j].text)) {
+					unique = false;
+					break;
+				}
+			}
+		}
+		if (unique) {
+			return seed;
+		}
+	}
+	return 0;
+}
+
+static constexpr u32 keyword_seed = find_keyword_seed();
+static_assert(keyword_seed != 0, "No perfect hash found for the keywords!");
+
+/**
+ * The perfect-hash table, every slot has the index of the keyword plus one, or
+ * 0 if it's empty.
+ */
+static constexpr auto keyword_slots = [] {
+	std::array<u8, keyword_slot_count> slots{};
+	for (u32 i = 0; i < keyword_count; ++i) {
+		slots[keyword_hash(keyword_seed, keyword_list[i].text)] = u8(i + 1);
+	}
+	return slots;
+}();
+
+/**
+ * Looks up an identifier-like word in the keywords.
+ * @param text The word to look up.
+ * @return The keyword token type, or Identifier if it's not a keyword.
+ */
+static token::type_t keyword_type(std::string_view text) {
+	auto slot = keyword_slots[keyword_hash(keyword_seed, text)];
+	if (slot != 0 && keyword_list[slot - 1].text == text) {
+		return keyword_list[slot - 1].type;
+	}
+	return token::Identifier;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 /**
  * Checks if a character is suitable for an identifier. Basically needs to match
  * [A-Za-z0-9_].
@@ -172,13 +302,14 @@ static bool is_ident(char ch) {
 token lexer::next() {
 	while (true) {
 		if (is_eof()) {
-			return token(m_Position, token::EndOfFile);
+			return token(m_Position, token::EndOfFile,
+				std::string_view(m_Source, 0));
 		}
 		if (parse_newline()) {
 			continue;
 		}
-		if (std::isblank(m_Source[0])) {
-			advance();
+		if (scan::is_blank(m_Source[0])) {
+			advance(scan::skip_blank(m_Source) - m_Source);
 			continue;
 		}
 
@@ -189,27 +320,31 @@ token lexer::next() {
 				// We don't actually need to keep track of positioning, that's
 				// why we modify the source directly
 				auto beg_pos = m_Position;
+				auto const* beg_src = m_Source;
 				advance(2);
 				auto end_pos = m_Position;
+				auto const* end_src = m_Source;
 				while (true) {
+					// Skip the run of visual characters at once
+					if (auto n = scan::skip_visible(m_Source) - m_Source) {
+						advance(n);
+						end_pos = m_Position;
+						end_src = m_Source;
+					}
+
 					if (is_eof()) {
 						break;
 					}
 					else if (parse_newline()) {
 						break;
 					}
-					else if (std::isgraph(m_Source[0])
-						|| std::isblank(m_Source[0])) {
-						// Visual
-						advance(1);
-						end_pos = m_Position;
-					}
 					else {
 						// Non-visual
 						++m_Source;
 					}
 				}
-				return token(range(beg_pos, end_pos), token::LineComment);
+				return token(range(beg_pos, end_pos), token::LineComment,
+					std::string_view(beg_src, end_src - beg_src));
 			}
 			else if (m_Source[1] == '*') {
 				// Nested comment
@@ -217,17 +352,22 @@ token lexer::next() {
 				// the middle of the line, where more code follows. For the
 				// actual code we need those token positions correctly.
 				auto beg_pos = m_Position;
+				auto const* beg_src = m_Source;
 				advance(2);
 
 				// We will use a counter instead of a stack, using a stack to
 				// keep track of nesting would be a huge overkill.
 				u32 depth = 1;
 				while (depth > 0) {
+					// Skip everything that can't be a newline or a comment
+					// delimiter
+					advance(scan::skip_comment_text(m_Source) - m_Source);
+
 					if (is_eof()) {
 						// XXX(LPeter1997): Better positioning? (end of last
 						// visible)
 						err::report(err::unclosed_comment(
-							m_Position, depth
+							current_position(), depth
 						));
 						break;
 					}
@@ -244,9 +384,9 @@ token lexer::next() {
 						advance(2);
 						--depth;
 					}
-					else if (std::isgraph(m_Source[0])
-						|| std::isblank(m_Source[0])) {
-						// Occupies space, advance in position
+					else if (scan::is_visible(m_Source[0])) {
+						// A lone '/' or '*', occupies space, advance in
+						// position
 						advance(1);
 					}
 					else {
@@ -254,7 +394,8 @@ token lexer::next() {
 						++m_Source;
 					}
 				}
-				return token(range(beg_pos, m_Position), token::NestedComment);
+				return token(range(beg_pos, m_Position), token::NestedComment,
+					std::string_view(beg_src, m_Source - beg_src));
 			}
 		} break;
 
@@ -285,21 +426,19 @@ token lexer::next() {
 				++len;
 			}
 
-			if (std::strncmp(m_Source, "fn", len) == 0) {
-				return make_simple(token::Keyword_Fn, len);
-			}
-			else if (std::strncmp(m_Source, "foreign", len) == 0) {
-				return make_simple(token::Keyword_Foreign, len);
+			auto ty = keyword_type(std::string_view(m_Source, len));
+			if (ty != token::Identifier) {
+				return make_simple(ty, len);
 			}
 			else {
-				return make_textual(token::Identifier, len);
+				return make_identifier(len);
 			}
 		}
 
 		// Unknown
 		if (std::isgraph(m_Source[0])) {
 			// Only error if a visible character
-			err::report(err::unexpected_char(m_Position, m_Source[0]));
+			err::report(err::unexpected_char(current_position(), m_Source[0]));
 			advance();
 		}
 		else {
@@ -311,4 +450,215 @@ token lexer::next() {
 	yk_unreachable;
 }
 
+// Parallel lexing /////////////////////////////////////////////////////////////
+
+// Sources smaller than this are not worth splitting
+static constexpr u32 min_chunk_size = 64 * 1024;
+
+/**
+ * A chunk of the source, that is lexed speculatively on it's own.
+ */
+struct lex_chunk {
+	u32 begin; // Offset of the first character (right after a newline)
+	u32 end; // Offset after the last character (right after a newline)
+	u32 row; // The row of the first character
+	// The lexed tokens, the last one is the first token that starts at or after
+	// the end of the chunk
+	std::vector<token> tokens;
+	// marks[i] is the number of errors reported until tokens[i] was returned
+	std::vector<u32> marks;
+	std::vector<err::error_t> errors;
+	// The chunk has a private interner, the symbols are mapped to the shared
+	// interner while stitching
+	interner symbols;
+	std::vector<symbol> symbol_map;
+	// The lexer is kept, in case lexing has to be continued from the end
+	std::optional<lexer> lex;
+};
+
+/**
+ * Counts the line breaks in a piece of source, with the same rules as the
+ * lexer ('\n', "\r\n" and '\r').
+ * @param p The start of the text.
+ * @param end The end of the text, must be right after a newline or at the
+ * null-terminator.
+ * @return The number of line breaks.
+ */
+static u32 count_rows(char const* p, char const* end) {
+	u32 rows = 0;
+	while (true) {
+		p = scan::skip_visible(p);
+		if (p >= end) {
+			return rows;
+		}
+		if (p[0] == '\n') {
+			++rows;
+			++p;
+		}
+		else if (p[0] == '\r') {
+			++rows;
+			p += (p[1] == '\n') ? 2 : 1;
+		}
+		else {
+			++p;
+		}
+	}
+}
+
+std::vector<token>
+lexer::all(source const& src, interner& syms, thread_pool& pool) {
+	auto const* base = src.data();
+	// The lexer stops at the first null character
+	auto size = u32(std::strlen(base));
+
+	// Split at newlines
+	auto target = std::max(min_chunk_size, size / (pool.size() * 4 + 1));
+	auto bounds = std::vector<u32>{ 0 };
+	while (size - bounds.back() > 2 * target) {
+		auto from = bounds.back() + target;
+		auto const* nl = static_cast<char const*>(
+			std::memchr(base + from, '\n', size - from));
+		if (!nl || u32(nl - base) + 1 >= size) {
+			break;
+		}
+		bounds.push_back(u32(nl - base) + 1);
+	}
+	bounds.push_back(size);
+	// With a single worker the stitching costs more than the parallelism gains
+	if (bounds.size() <= 2 || pool.size() < 2) {
+		return all(src, syms);
+	}
+
+	auto chunks = std::vector<lex_chunk>(bounds.size() - 1);
+	for (std::size_t i = 0; i < chunks.size(); ++i) {
+		chunks[i].begin = bounds[i];
+		chunks[i].end = bounds[i + 1];
+	}
+	auto const n = u32(chunks.size());
+	auto offset_of = [base](token const& t) {
+		return u32(t.text().data() - base);
+	};
+
+	// The rows where the chunks start
+	pool.for_each(n, [&](u32 i) {
+		auto& c = chunks[i];
+		c.row = count_rows(base + c.begin, base + c.end);
+	});
+	u32 row = 0;
+	for (auto& c : chunks) {
+		auto rows = c.row;
+		c.row = row;
+		row += rows;
+	}
+
+	// Lex the chunks, assuming that none of them starts inside a comment
+	pool.for_each(n, [&](u32 i) {
+		auto& c = chunks[i];
+		c.lex.emplace(base + c.begin, position::row_col(c.row, 0), c.symbols);
+		auto mark = err::errors().size();
+		while (true) {
+			c.tokens.push_back(c.lex->next());
+			c.marks.push_back(u32(err::errors().size() - mark));
+			auto const& t = c.tokens.back();
+			if (t.type() == token::EndOfFile || offset_of(t) >= c.end) {
+				break;
+			}
+		}
+		auto const& errs = err::errors();
+		c.errors.assign(errs.begin() + mark, errs.end());
+		err::truncate(mark);
+	});
+
+	// Stitch the chunks together in order
+	auto result = std::vector<token>();
+	auto errors = std::vector<err::error_t>();
+	std::size_t total = 0;
+	for (auto const& c : chunks) {
+		total += c.tokens.size();
+	}
+	result.reserve(total);
+
+	auto remap = [&syms](lex_chunk& c, token const& t) {
+		if (t.type() != token::Identifier) {
+			return t;
+		}
+		auto id = t.name().id();
+		if (id >= c.symbol_map.size()) {
+			c.symbol_map.resize(c.symbols.size());
+		}
+		auto& sym = c.symbol_map[id];
+		if (!sym.is_valid()) {
+			sym = syms.intern(c.symbols.str(t.name()));
+		}
+		return token(t.start(), t.text(), sym);
+	};
+	auto errors_of = [](lex_chunk const& c, u32 i) {
+		auto from = (i == 0) ? 0 : c.marks[i - 1];
+		return std::vector<err::error_t>(
+			c.errors.begin() + from, c.errors.begin() + c.marks[i]);
+	};
+	auto emit = [&](token const& t, std::vector<err::error_t>&& errs) {
+		result.push_back(t);
+		errors.insert(errors.end(),
+			std::make_move_iterator(errs.begin()),
+			std::make_move_iterator(errs.end()));
+	};
+	// Emits the tokens (from..last) of a chunk, and makes the last one pending
+	auto take = [&](lex_chunk& c, u32 from,
+		std::optional<token>& pending, std::vector<err::error_t>& pend_errs) {
+		auto last = u32(c.tokens.size()) - 1;
+		for (auto i = from; i < last; ++i) {
+			emit(remap(c, c.tokens[i]), errors_of(c, i));
+		}
+		pending = remap(c, c.tokens[last]);
+		pend_errs = errors_of(c, last);
+	};
+
+	// The first token that is correctly lexed, but not emitted yet. It's either
+	// the last token of a chunk or comes from serially continuing a chunk.
+	std::optional<token> pending;
+	auto pend_errs = std::vector<err::error_t>();
+	u32 owner = 0;
+	take(chunks[0], 0, pending, pend_errs);
+
+	for (u32 k = 1; k < n; ++k) {
+		auto& c = chunks[k];
+		while (true) {
+			auto off = offset_of(*pending);
+			auto it = std::lower_bound(c.tokens.begin(), c.tokens.end(), off,
+				[&](token const& t, u32 o) { return offset_of(t) < o; });
+			if (it != c.tokens.end() && offset_of(*it) == off) {
+				// Synchronized, the rest of the chunk is correct
+				auto j = u32(it - c.tokens.begin());
+				if (j + 1 < c.tokens.size()) {
+					emit(*pending, std::move(pend_errs));
+					take(c, j + 1, pending, pend_errs);
+				}
+				owner = k;
+				break;
+			}
+			if (off >= offset_of(c.tokens.back())) {
+				// The pending token is past this chunk, skip the chunk entirely
+				break;
+			}
+			// Wrong speculation, continue lexing serially
+			emit(*pending, std::move(pend_errs));
+			auto& o = chunks[owner];
+			auto mark = err::errors().size();
+			auto t = o.lex->next();
+			auto const& errs = err::errors();
+			pend_errs.assign(errs.begin() + mark, errs.end());
+			err::truncate(mark);
+			pending = remap(o, t);
+		}
+	}
+	yk_assert(pending->type() == token::EndOfFile);
+	emit(*pending, std::move(pend_errs));
+
+	for (auto& e : errors) {
+		err::report(std::move(e));
+	}
+	return result;
+}
+
 } /* namespace yk */
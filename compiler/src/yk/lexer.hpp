@@ -10,12 +10,17 @@
 #define YK_LEXER_HPP
 
 #include <algorithm>
-#include <string>
+#include <string_view>
 #include <vector>
 #include "common.hpp"
+#include "interner.hpp"
+#include "source.hpp"
 
 namespace yk {
 
+struct line_index;
+struct thread_pool;
+
 /**
  * Holds positional information with a row and column number.
  */
@@ -123,6 +128,15 @@ bool operator<=(range const& a, range const& b);
 bool operator>(range const& a, range const& b);
 bool operator>=(range const& a, range const& b);
 
+/**
+ * The list of keywords, every entry is X(name, text). This single list
+ * generates the keyword token types (Keyword_<name>), their lengths and the
+ * keyword lookup table of the lexer.
+ */
+#define YK_KEYWORDS(X) \
+	X(Fn, "fn") \
+	X(Foreign, "foreign")
+
 /**
  * The atomic result of the lexical analysis.
  */
@@ -140,8 +154,9 @@ struct token {
 		LeftBrace,			// '{'
 		RightBrace,			// '}'
 		Colon,				// ':'
-		Keyword_Fn,			// 'fn'
-		Keyword_Foreign,	// 'foreign'
+#define YK_KEYWORD_TYPE(name, text) Keyword_##name,
+		YK_KEYWORDS(YK_KEYWORD_TYPE)
+#undef YK_KEYWORD_TYPE
 		Identifier,			// [A-Za-z_][A-Za-z0-9_]*
 		Integer,			// [0-9]+
 	};
@@ -155,29 +170,67 @@ struct token {
 	 * Creates a token.
 	 * @param pos The starting position of the token.
 	 * @param ty The type of the token.
-	 * @param val The textual value of the token. Only required if it contains
-	 * semantic information, like numbers and identifiers. Empty by default.
+	 * @param text The text of the token in the source. The token does not own
+	 * the text, it only refers to it.
+	 */
+	explicit token(position const& pos, type_t ty, std::string_view text)
+		: token(calculate_range(pos, ty, text), ty, text) {
+	}
+
+	/**
+	 * Creates an identifier token.
+	 * @param pos The starting position of the token.
+	 * @param text The text of the token in the source.
+	 * @param sym The interned name of the identifier.
 	 */
-	explicit token(position const& pos, type_t ty, std::string&& val = "")
-		: token(calculate_range(pos, ty, val), ty, std::move(val)) {
+	explicit token(position const& pos, std::string_view text, symbol sym)
+		: token(pos, Identifier, text) {
+		m_Symbol = sym;
 	}
 
 	/**
 	 * Creates a token.
 	 * @param r The range of the token.
 	 * @param ty The type of the token.
-	 * @param val The textual value of the token. Only required if it contains
-	 * semantic information, like numbers and identifiers. Empty by default.
+	 * @param text The text of the token in the source. The token does not own
+	 * the text, it only refers to it.
 	 */
-	explicit token(range const& r, type_t ty, std::string&& val = "")
-		: m_Range(r), m_Type(ty), m_Value(std::move(val)) {
+	explicit token(range const& r, type_t ty, std::string_view text)
+		: m_Range(r), m_Type(ty), m_Symbol(), m_Text(text) {
 	}
 
 	range const& range_() const { return m_Range; }
 	position const& start() const { return range_().start(); }
 	position const& end() const { return range_().end(); }
 	type_t const& type() const { return m_Type; }
-	std::string const& value() const { return m_Value; }
+	std::string_view text() const { return m_Text; }
+	symbol name() const { return m_Symbol; }
+
+	/**
+	 * Gets the textual value of the token. Only tokens with semantic
+	 * information, like numbers and identifiers have a value.
+	 * @return The value of the token, or an empty view, if the token has no
+	 * semantic text.
+	 */
+	std::string_view value() const {
+		return (type() == Identifier || type() == Integer)
+			? text() : std::string_view();
+	}
+
+	/**
+	 * Creates a copy of this token that is placed somewhere else, like when the
+	 * text before it has been edited.
+	 * @param r The new range of the token.
+	 * @param text The new text of the token (same content, but possibly
+	 * referring into a different source).
+	 * @return The relocated token.
+	 */
+	token relocated(range const& r, std::string_view text) const {
+		auto result = *this;
+		result.m_Range = r;
+		result.m_Text = text;
+		return result;
+	}
 
 	/**
 	 * Gets the length of the token.
@@ -192,11 +245,13 @@ struct token {
 
 private:
 	static range
-	calculate_range(position const& pos, type_t ty, std::string const& val);
+	calculate_range(position const& pos, type_t ty, std::string_view text);
 
 	range m_Range;
 	type_t m_Type;
-	std::string m_Value;
+	symbol m_Symbol; // Only valid for identifiers
+	std::string_view m_Text; // Refers into the source, not owned
+
 };
 
 /**
@@ -206,9 +261,35 @@ struct lexer {
 	/**
 	 * A utility function that lexes a whole source string until the end and
 	 * returns the resulting tokens in a vector (including the EndOfFile token).
+	 * @param src The source as a null-terminated character sequence.
+	 * @param syms The interner for the identifier names.
+	 * @return A vector of tokens.
+	 */
+	static std::vector<token> all(char const* src, interner& syms);
+
+	/**
+	 * Lexes a whole owned source. The tokens refer into the source, so it has to
+	 * outlive the returned tokens.
+	 * @param src The source to lex.
+	 * @param syms The interner for the identifier names.
+	 * @return A vector of tokens.
+	 */
+	static std::vector<token> all(source const& src, interner& syms);
+
+	/**
+	 * Lexes a whole owned source in parallel. The source is split into chunks
+	 * at newlines and every chunk is lexed on the thread pool, speculating that
+	 * it does not start inside a comment. The chunks are then stitched together
+	 * in order, re-lexing serially where the speculation was wrong, until the
+	 * token streams agree again. The resulting tokens and the reported errors
+	 * are exactly the same as with the serial lexing.
+	 * @param src The source to lex.
+	 * @param syms The interner for the identifier names.
+	 * @param pool The thread pool to lex the chunks on.
 	 * @return A vector of tokens.
 	 */
-	static std::vector<token> all(char const* src);
+	static std::vector<token>
+	all(source const& src, interner& syms, thread_pool& pool);
 
 	/**
 	 * Utility to find a token at a given position.
@@ -234,11 +315,36 @@ struct lexer {
 	/**
 	 * Creates a lexer for a given source text.
 	 * @param src The source as a null-terminated character sequence.
+	 * @param syms The interner for the identifier names.
+	 */
+	explicit lexer(char const* src, interner& syms)
+		: lexer(src, position::zero(), syms) {
+	}
+
+	/**
+	 * Creates a lexer that continues from the middle of a source text. This is
+	 * how a lexer is restarted from a checkpoint. The only state of the lexer
+	 * between two tokens is it's location, as comments are lexed as a whole
+	 * (the nesting depth is always 0 outside of a comment token), so the start
+	 * of any token is a valid checkpoint.
+	 * @param src The source pointer to continue from.
+	 * @param pos The position of the source pointer.
+	 * @param syms The interner for the identifier names.
 	 */
-	explicit lexer(char const* src)
-		: m_Source(src), m_Position(position::zero()) {
+	explicit lexer(char const* src, position const& pos, interner& syms)
+		: m_Source(src), m_Position(pos), m_Symbols(&syms), m_Lines(nullptr) {
 	}
 
+	/**
+	 * Creates a lexer in offset mode. The lexer does not track the row and
+	 * column while lexing, only the token texts (and so their offsets) are
+	 * meaningful, the token ranges are not. The positions of the reported
+	 * errors are looked up in the line index.
+	 * @param lines The line index of the source to lex.
+	 * @param syms The interner for the identifier names.
+	 */
+	explicit lexer(line_index const& lines, interner& syms);
+
 	/**
 	 * Returns the next token from the source file.
 	 * @return The next token. The type will be EndOfFile, if the end of source
@@ -260,6 +366,12 @@ private:
 	 */
 	bool is_eof() const;
 
+	/**
+	 * Returns the current position, for error reporting.
+	 * @return The position of the source pointer.
+	 */
+	position current_position() const;
+
 	/**
 	 * Tries to parse a newline from the source. If a newline is found, skips
 	 * it in the source.
@@ -280,7 +392,7 @@ private:
 	/**
 	 * Creates a token at the current position and advances the horizontal
 	 * position (columns) by a given amount. Also provides the sliced text for
-	 * the token.
+	 * the token. The text is not copied, the token refers into the source.
 	 * @param ty The type of the token to create.
 	 * @param len The horizontal length of the token (amount to advance).
 	 * @return A new token at the current position with the given type with the
@@ -288,8 +400,18 @@ private:
 	 */
 	token make_textual(token::type_t ty, u32 len);
 
+	/**
+	 * Creates an identifier token at the current position, interning it's name,
+	 * and advances the horizontal position (columns) by a given amount.
+	 * @param len The length of the identifier (amount to advance).
+	 * @return A new identifier token at the current position.
+	 */
+	token make_identifier(u32 len);
+
 	char const* m_Source; // Source pointer
 	position m_Position; // Current position
+	interner* m_Symbols; // Identifier names
+	line_index const* m_Lines; // Only in offset mode
 };
 
 } /* namespace yk */
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include "line_index.hpp"
+#include "scan.hpp"
+
+namespace yk {
+
+line_index::line_index(char const* text)
+	: m_Text(text), m_End(0) {
+	m_Lines.push_back(0);
+	auto const* p = m_Text;
+	while (true) {
+		// Everything visible is skipped in vectorized chunks
+		p = scan::skip_visible(p);
+		if (p[0] == '\0') {
+			break;
+		}
+		else if (p[0] == '\n') {
+			++p;
+			m_Lines.push_back(u32(p - m_Text));
+		}
+		else if (p[0] == '\r') {
+			p += (p[1] == '\n') ? 2 : 1;
+			m_Lines.push_back(u32(p - m_Text));
+		}
+		else {
+			// Control character or non-ASCII
+			auto row = u32(m_Lines.size()) - 1;
+			if (m_Irregular.empty() || m_Irregular.back() != row) {
+				m_Irregular.push_back(row);
+			}
+			++p;
+		}
+	}
+	m_End = u32(p - m_Text);
+}
+
+bool line_index::is_irregular(u32 row) const {
+	return std::binary_search(m_Irregular.begin(), m_Irregular.end(), row);
+}
+
+position line_index::position_of(u32 off) const {
+	auto it = std::upper_bound(m_Lines.begin(), m_Lines.end(), off);
+	auto row = u32(it - m_Lines.begin()) - 1;
+	auto start = m_Lines[row];
+	auto col = off - start;
+	if (is_irregular(row)) {
+		for (auto o = start; o < off; ++o) {
+			if (!scan::is_visible(m_Text[o])) {
+				--col;
+			}
+		}
+	}
+	return position::row_col(row, col);
+}
+
+u32 line_index::offset_of(position const& pos) const {
+	if (pos.row() >= rows()) {
+		return m_End;
+	}
+	auto start = m_Lines[pos.row()];
+	if (!is_irregular(pos.row())) {
+		// Every character is visible until the line break
+		auto end = m_End;
+		if (pos.row() + 1 < rows()) {
+			end = m_Lines[pos.row() + 1] - 1;
+			if (m_Text[end] == '\n' && end > start && m_Text[end - 1] == '\r') {
+				--end;
+			}
+		}
+		return start + std::min(pos.column(), end - start);
+	}
+	auto const* p = m_Text + start;
+	// Count the columns, only visible characters occupy one
+	for (u32 col = pos.column(); col > 0;) {
+		if (scan::is_visible(p[0])) {
+			--col;
+			++p;
+		}
+		else if (p[0] == '\0' || p[0] == '\n' || p[0] == '\r') {
+			break;
+		}
+		else {
+			++p;
+		}
+	}
+	return u32(p - m_Text);
+}
+
+} /* namespace yk */
@@ -0,0 +1,104 @@
+/**
+ * line_index.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description The line-start table of a document, that converts between byte
+ * offsets and row-column positions.
+ */
+
+#ifndef YK_LINE_INDEX_HPP
+#define YK_LINE_INDEX_HPP
+
+#include <vector>
+#include "common.hpp"
+#include "lexer.hpp"
+#include "source.hpp"
+
+namespace yk {
+
+/**
+ * Stores where each row of a source starts, so byte offsets can be converted
+ * to positions (and back) with a binary search. This way the tokens only need
+ * to carry offsets, that are compared as plain integers, and the row-column
+ * form is only needed where positions leave the compiler.
+ * The rows and columns follow the same rules as the lexer: '\n', "\r\n" and
+ * '\r' are line breaks, and only visible characters occupy a column.
+ */
+struct line_index {
+	/**
+	 * Builds the index of a source with the vectorized character scanner. The
+	 * source has to outlive the index, but the source object can be moved.
+	 * @param src The source to index.
+	 */
+	explicit line_index(source const& src)
+		: line_index(src.data()) {
+	}
+
+	/**
+	 * Builds the index of a text, that is not owned by a source, like one in a
+	 * mapped file.
+	 * @param text The null-terminated text to index, it has to outlive the
+	 * index.
+	 */
+	explicit line_index(char const* text);
+
+	/**
+	 * Returns the indexed text.
+	 * @return The pointer to the first character of the source.
+	 */
+	char const* text() const { return m_Text; }
+
+	/**
+	 * Returns the offset of the end of the text, where the lexer stops (the
+	 * first null character).
+	 * @return The offset of the end.
+	 */
+	u32 end() const { return m_End; }
+
+	/**
+	 * Returns the number of rows in the text.
+	 * @return The number of rows, at least 1.
+	 */
+	u32 rows() const { return u32(m_Lines.size()); }
+
+	/**
+	 * Returns the offset where a row starts.
+	 * @param row The index of the row.
+	 * @return The offset of the first character of the row.
+	 */
+	u32 row_start(u32 row) const { return m_Lines[row]; }
+
+	/**
+	 * Converts a byte offset to a position.
+	 * @param off The offset to convert.
+	 * @return The position of the offset.
+	 */
+	position position_of(u32 off) const;
+
+	/**
+	 * Converts a position to a byte offset.
+	 * @param pos The position to convert. Positions outside of the text are
+	 * clamped to the end of the row or the end of the text.
+	 * @return The byte offset of the position.
+	 */
+	u32 offset_of(position const& pos) const;
+
+private:
+	/**
+	 * Checks if a row contains non-visible characters, in which case columns
+	 * and byte offsets can't be converted with a subtraction.
+	 * @param row The index of the row.
+	 * @return True, if the row has characters that occupy no column.
+	 */
+	bool is_irregular(u32 row) const;
+
+	char const* m_Text;
+	u32 m_End;
+	std::vector<u32> m_Lines; // The offsets of the row starts
+	std::vector<u32> m_Irregular; // Rows with non-visible characters
+};
+
+} /* namespace yk */
+
+#endif /* YK_LINE_INDEX_HPP */
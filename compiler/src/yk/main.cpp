@@ -1,7 +1,12 @@
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
-#include "error.hpp"
-#include "lexer.hpp"
-#include "parser.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "driver.hpp"
+#include "profile.hpp"
 
 // XXX(LPeter1997): We could remove std::vector dependency everywhere by using
 // iterator pairs. That is more idiomatic C++.
@@ -12,17 +17,82 @@
 // Sometimes we use shorthands like pos(), or use postfixes like range_().
 // End it once and for all!
 
-char const* test_src = R"(
+static void usage(char const* exe) {
+	std::cerr
+		<< "Usage: " << exe << " [options] <inputs...>\n"
+		<< "Inputs can be files, directories (every .yk file in them), glob patterns\n"
+		<< "(with *, ? and **) or @file for a list of inputs, one per line.\n"
+		<< "  -j <n>           Number of threads (the hardware threads by default)\n"
+		<< "  --cache <dir>    Restore unchanged files from and store the results in <dir>\n"
+		<< "  --profile        Report the time and memory of every phase, per file and in total\n"
+		<< "  --profile-json <file>  Also write the profile as JSON\n";
+}
 
-	fn main() foreign;
-	fn foo() foreign;
+int main(int argc, char** argv) {
+	auto opts = yk::driver_options();
+	auto inputs = std::vector<std::string>();
+	auto json_path = std::optional<std::string>();
+	for (int i = 1; i < argc; ++i) {
+		auto arg = std::string_view(argv[i]);
+		if (arg == "-j" && i + 1 < argc) {
+			opts.jobs = yk::u32(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--cache" && i + 1 < argc) {
+			opts.cache = argv[++i];
+		}
+		else if (arg == "--profile") {
+			opts.profile = true;
+		}
+		else if (arg == "--profile-json" && i + 1 < argc) {
+			opts.profile = true;
+			json_path = argv[++i];
+		}
+		else if (arg.size() > 1 && arg[0] == '-') {
+			usage(argv[0]);
+			return 2;
+		}
+		else {
+			inputs.emplace_back(arg);
+		}
+	}
+	if (inputs.empty()) {
+		usage(argv[0]);
+		return 2;
+	}
 
-)";
+	auto files = yk::expand_inputs(inputs, std::cerr);
+	if (!files) {
+		return 2;
+	}
+	auto summary = yk::compile_batch(*files, opts, std::cout);
 
-int main() {
-	yk::err::init();
-	auto toks = yk::lexer::all(test_src);
-	auto decls = yk::parser::all(toks);
-	std::cout << decls.size() << " no. declarations" << std::endl;
-	return 0;
+	double mbytes = double(summary.bytes) / (1024.0 * 1024.0);
+	std::cout
+		<< summary.files << " files (" << summary.cached << " cached), "
+		<< summary.bytes << " bytes, "
+		<< summary.tokens << " tokens, "
+		<< summary.decls << " declarations, "
+		<< summary.errors << " errors in "
+		<< summary.seconds * 1000.0 << " ms";
+	if (summary.seconds > 0.0) {
+		std::cout
+			<< " (" << mbytes / summary.seconds << " MB/s, "
+			<< double(summary.tokens) / summary.seconds << " tokens/s)";
+	}
+	std::cout << std::endl;
+	if (opts.profile) {
+		yk::write_profile_table(std::cout, summary.phases);
+	}
+	if (json_path) {
+		auto json = std::ofstream(*json_path);
+		yk::write_profile_json(json, *files, summary.profiles, summary.phases, summary.seconds);
+		if (!json) {
+			std::cerr << "yk: can't write the profile: " << *json_path << std::endl;
+			return 2;
+		}
+	}
+	if (summary.unreadable > 0) {
+		return 2;
+	}
+	return (summary.errors > 0) ? 1 : 0;
 }
@@ -0,0 +1,110 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace yk {
+
+std::optional<mapped_file>
+mapped_file::open(std::filesystem::path const& path, bool terminate) {
+#ifdef _WIN32
+	auto file = std::ifstream(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		return std::nullopt;
+	}
+	auto size = std::size_t(file.tellg());
+	if (size == 0) {
+		return mapped_file(nullptr, 0, 0);
+	}
+	auto length = size + (terminate ? 1 : 0);
+	auto* data = static_cast<char*>(::operator new(length));
+	file.seekg(0);
+	if (!file.read(data, size)) {
+		::operator delete(data);
+		return std::nullopt;
+	}
+	if (terminate) {
+		data[size] = '\0';
+	}
+	return mapped_file(data, size, length);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return std::nullopt;
+	}
+	struct stat st;
+	if (::fstat(fd, &st) != 0) {
+		::close(fd);
+		return std::nullopt;
+	}
+	auto size = std::size_t(st.st_size);
+	if (size == 0) {
+		// Zero-length mappings are not allowed
+		::close(fd);
+		return mapped_file(nullptr, 0, 0);
+	}
+	auto page = std::size_t(::sysconf(_SC_PAGESIZE));
+	auto mapped = size;
+	void* data;
+	if (terminate && size % page == 0) {
+		// Reserve a zero page after the contents, then map the file over the
+		// start of it
+		mapped = size + page;
+		void* area = ::mmap(nullptr, mapped, PROT_READ,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		data = (area == MAP_FAILED) ? MAP_FAILED
+			: ::mmap(area, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+		if (area != MAP_FAILED && data == MAP_FAILED) {
+			::munmap(area, mapped);
+		}
+	}
+	else {
+		data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+	if (data == MAP_FAILED) {
+		return std::nullopt;
+	}
+	return mapped_file(data, size, mapped);
+#endif
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+	: m_Data(other.m_Data), m_Size(other.m_Size), m_Mapped(other.m_Mapped) {
+	other.m_Data = nullptr;
+	other.m_Size = 0;
+	other.m_Mapped = 0;
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+	if (this != &other) {
+		this->~mapped_file();
+		m_Data = other.m_Data;
+		m_Size = other.m_Size;
+		m_Mapped = other.m_Mapped;
+		other.m_Data = nullptr;
+		other.m_Size = 0;
+		other.m_Mapped = 0;
+	}
+	return *this;
+}
+
+mapped_file::~mapped_file() {
+	if (!m_Data) {
+		return;
+	}
+#ifdef _WIN32
+	::operator delete(const_cast<void*>(m_Data));
+#else
+	::munmap(const_cast<void*>(m_Data), m_Mapped);
+#endif
+}
+
+} /* namespace yk */
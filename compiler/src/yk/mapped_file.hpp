@@ -0,0 +1,61 @@
+/**
+ * mapped_file.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Read-only memory mapping of whole files.
+ */
+
+#ifndef YK_MAPPED_FILE_HPP
+#define YK_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+namespace yk {
+
+/**
+ * A read-only file mapped into memory. On platforms without mmap support, the
+ * file is read into a buffer instead.
+ */
+struct mapped_file {
+	/**
+	 * Maps a file. An empty file has no mapping, it's data is nullptr.
+	 * @param path The path of the file.
+	 * @param terminate True, if there has to be a zero byte after the
+	 * contents, so the text can be lexed in place. The rest of the last page
+	 * is zero anyway, only a file filling it's last page needs an extra page.
+	 * @return The mapping, or nullopt if the file can't be opened.
+	 */
+	static std::optional<mapped_file>
+	open(std::filesystem::path const& path, bool terminate = false);
+
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+	mapped_file(mapped_file&& other) noexcept;
+	mapped_file& operator=(mapped_file&& other) noexcept;
+
+	~mapped_file();
+
+	void const* data() const { return m_Data; }
+	std::size_t size() const { return m_Size; }
+
+	std::string_view text() const {
+		return std::string_view(static_cast<char const*>(m_Data), m_Size);
+	}
+
+private:
+	mapped_file(void const* data, std::size_t size, std::size_t mapped)
+		: m_Data(data), m_Size(size), m_Mapped(mapped) {
+	}
+
+	void const* m_Data;
+	std::size_t m_Size;
+	std::size_t m_Mapped; // The length of the mapping, or the buffer
+};
+
+} /* namespace yk */
+
+#endif /* YK_MAPPED_FILE_HPP */
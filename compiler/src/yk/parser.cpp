@@ -1,16 +1,28 @@
+#include <algorithm>
 #include "ast.hpp"
 #include "error.hpp"
 #include "parser.hpp"
+#include "thread_pool.hpp"
 
 namespace yk {
 
-std::vector<stmt*> parser::all(std::vector<token> const& toks) {
-	auto p = parser(toks);
+stmt_list parser::all(std::vector<token> const& toks, arena& nodes) {
+	auto p = parser(toks, nodes);
 	return p.decl_list();
 }
 
-std::vector<stmt*> parser::decl_list() {
-	std::vector<stmt*> result;
+stmt_list parser::all(token_table const& toks, arena& nodes) {
+	auto p = parser(toks, nodes);
+	return p.decl_list();
+}
+
+stmt_list parser::all(lexer& lex, arena& nodes) {
+	auto p = parser(lex, nodes);
+	return p.decl_list();
+}
+
+stmt_list parser::decl_list() {
+	auto result = stmt_list(arena_allocator<stmt*>(*m_Nodes));
 	while (!is_eof()) {
 		if (auto* d = decl()) {
 			result.push_back(d);
@@ -20,98 +32,266 @@ std::vector<stmt*> parser::decl_list() {
 }
 
 stmt* parser::decl() {
-	if (auto* fn_kw = match(token::Keyword_Fn)) {
+	if (auto fn_kw = match(token::Keyword_Fn)) {
 		// 'fn'
 
-		auto* fn_name = expect(token::Identifier, "function name");
-		if (!fn_name) return nullptr;
+		auto fn_name = expect(token::Identifier, "function name");
+		if (!fn_name) return recover();
 
 		// 'fn' name
 
-		expect(token::LeftParen, "'('");
-		expect(token::RightParen, "')'");
+		if (!expect(token::LeftParen, "'('")) return recover();
+		if (!expect(token::RightParen, "')'")) return recover();
 
 		// 'fn' name()
 
 		// If foreign token, it's a declaration. Definition otherwise.
 
-		if (auto* foreign_kw = match(token::Keyword_Foreign)) {
+		if (auto foreign_kw = match(token::Keyword_Foreign)) {
 			// Declaration
-			expect(token::Semicolon, "';'");
-			return stmt::fdecl::make_stmt(*fn_name);
+			if (!expect(token::Semicolon, "';'")) return recover();
+			return stmt::fdecl::make_stmt(*m_Nodes, *fn_name);
 		}
 		else {
 			auto body = block();
-			if (!body) return nullptr;
+			if (!body) return recover();
 
 			// XXX(LPeter1997): If there was no body, we could return a
 			// pseudo-body so the function signature would be registered for
 			// semantic checking.
 
-			return stmt::fdef::make_stmt(*fn_name, std::move(*body));
+			return stmt::fdef::make_stmt(*m_Nodes, *fn_name, std::move(*body));
 		}
 	}
 	else {
 		err::report(err::unexpected_token(peek(), "declaration"));
-		// Consume so we don't get stuck here
-		// XXX(LPeter1997): Might be a better strategy to sync to the next decl
-		// token
+		// Skip the whole run of garbage, so it's only reported once. Consume
+		// at least one token, so we don't get stuck here.
 		consume();
+		while (!is_eof() && peek().type() != token::Keyword_Fn) {
+			consume();
+		}
 	}
 	return nullptr;
 }
 
 std::optional<expr::block> parser::block() {
-	if (auto* lbrace = expect(token::LeftBrace, "'{'")) {
-		auto* rbrace = expect(token::RightBrace, "'}'");
+	if (auto lbrace = expect(token::LeftBrace, "'{'")) {
+		auto rbrace = expect(token::RightBrace, "'}'");
 		// XXX(LPeter1997): Auto-close to continue? (no need to throw away the
 		// block)
 		if (!rbrace) return std::nullopt;
 
-		return expr::block::make(*lbrace, *rbrace, {}, nullptr);
+		return expr::block::make(*lbrace, *rbrace,
+			stmt_list(arena_allocator<stmt*>(*m_Nodes)), nullptr);
 	}
 	return std::nullopt;
 }
 
 // Helper functionality
 
-token const* parser::match(token::type_t tag) {
-	token const& t = peek();
-	if (t.type() == tag) {
-		return &consume();
+std::optional<token> parser::match(token::type_t tag) {
+	if (peek().type() == tag) {
+		return consume();
 	}
 	else {
-		return nullptr;
+		return std::nullopt;
 	}
 }
 
-token const* parser::expect(token::type_t tag, char const* desc) {
-	// XXX(LPeter1997): Maybe not consume but synchronize?
-	token const& t = peek();
-	if (t.type() == tag) {
-		return &consume();
+std::optional<token> parser::expect(token::type_t tag, char const* desc) {
+	if (peek().type() == tag) {
+		return consume();
 	}
 	else {
-		if (!is_eof()) {
-			consume();
+		// Not consumed, the caller recovers by synchronizing
+		err::report(err::expected_token(peek(), desc));
+		return std::nullopt;
+	}
+}
+
+stmt* parser::recover() {
+	// Every error of the declaration would follow from the first one, so the
+	// tokens are skipped without reporting anything
+	while (!is_eof()) {
+		auto type = peek().type();
+		if (type == token::Keyword_Fn) {
+			break;
 		}
-		err::report(err::expected_token(t, desc));
-		return nullptr;
+		consume();
+		if (type == token::RightBrace) {
+			break;
+		}
+	}
+	return nullptr;
+}
+
+token parser::pull() const {
+	if (m_Lexer) {
+		return m_Lexer->next();
 	}
+	// Past the end the EOF token is repeated, just like the lexer does
+	auto last = m_Table->size() - 1;
+	auto t = (*m_Table)[std::min(m_Index, last)];
+	if (m_Index <= last) {
+		++m_Index;
+	}
+	return t;
 }
 
 token const& parser::peek(u32 delta) const {
-	return (*m_Tokens)[m_Index + delta];
+	if (m_Tokens) {
+		return (*m_Tokens)[m_Index + delta];
+	}
+	yk_assert(delta < lookahead);
+	while (m_Buffered <= delta) {
+		m_Ring[(m_Head + m_Buffered) % lookahead] = pull();
+		++m_Buffered;
+	}
+	return *m_Ring[(m_Head + delta) % lookahead];
 }
 
-token const& parser::consume() {
-	auto const& t = peek();
-	++m_Index;
+token parser::consume() {
+	auto t = peek();
+	if (!m_Tokens) {
+		m_Head = (m_Head + 1) % lookahead;
+		--m_Buffered;
+	}
+	else {
+		++m_Index;
+	}
 	return t;
 }
 
 bool parser::is_eof() const {
-	return m_Index >= m_Tokens->size() - 1;
+	return peek().type() == token::EndOfFile;
+}
+
+u32 parser::index() const {
+	yk_assert(!m_Lexer);
+	return m_Tokens ? m_Index : m_Index - m_Buffered;
+}
+
+// Parallel parsing ////////////////////////////////////////////////////////////
+
+// Token vectors smaller than this are not worth splitting
+static constexpr u32 min_chunk_tokens = 16 * 1024;
+
+/**
+ * A chunk of the tokens, that is parsed speculatively on it's own.
+ */
+struct parse_chunk {
+	u32 begin; // Index of the first token (a 'fn', except in the first chunk)
+	u32 end; // Index of the first token of the next chunk
+	// The parse steps, step i starts at firsts[i] and produces decls[i] (which
+	// can be nullptr). The last step is the first one that ends at or after
+	// the end of the chunk.
+	std::vector<u32> firsts;
+	std::vector<stmt*> decls;
+	// marks[i] is the number of errors reported until step i finished
+	std::vector<u32> marks;
+	std::vector<err::error_t> errors;
+	u32 last; // The index of the token after the last step
+	// The nodes are allocated from a private arena, that is adopted when merging
+	arena* nodes;
+};
+
+stmt_list
+parser::all(std::vector<token> const& toks, arena& nodes, thread_pool& pool) {
+	auto size = u32(toks.size());
+
+	// Split at 'fn' keywords, the last boundary is the EndOfFile token
+	auto target = std::max(min_chunk_tokens, size / (pool.size() * 4 + 1));
+	auto bounds = std::vector<u32>{ 0 };
+	while (size - bounds.back() > 2 * target) {
+		auto it = std::find_if(toks.begin() + bounds.back() + target, toks.end(),
+			[](token const& t) { return t.type() == token::Keyword_Fn; });
+		if (it == toks.end()) {
+			break;
+		}
+		bounds.push_back(u32(it - toks.begin()));
+	}
+	bounds.push_back(size - 1);
+	// With a single worker the merging costs more than the parallelism gains
+	if (bounds.size() <= 2 || pool.size() < 2) {
+		return all(toks, nodes);
+	}
+
+	auto chunks = std::vector<parse_chunk>(bounds.size() - 1);
+	for (std::size_t i = 0; i < chunks.size(); ++i) {
+		chunks[i].begin = bounds[i];
+		chunks[i].end = bounds[i + 1];
+		// Allocated in the shared arena, so allocators referring to it stay
+		// valid after the chunks are adopted
+		chunks[i].nodes = nodes.make<arena>();
+	}
+	auto const n = u32(chunks.size());
+
+	// Parse the chunks, assuming that each of them starts at a declaration
+	pool.for_each(n, [&](u32 i) {
+		auto& c = chunks[i];
+		auto p = parser(toks, *c.nodes, c.begin);
+		auto mark = err::errors().size();
+		while (!p.is_eof() && p.index() < c.end) {
+			c.firsts.push_back(p.index());
+			c.decls.push_back(p.decl());
+			c.marks.push_back(u32(err::errors().size() - mark));
+		}
+		c.last = p.index();
+		auto const& errs = err::errors();
+		c.errors.assign(errs.begin() + mark, errs.end());
+		err::truncate(mark);
+	});
+
+	// Merge the chunks in order
+	auto result = stmt_list(arena_allocator<stmt*>(nodes));
+	auto errors = std::vector<err::error_t>();
+	// Takes the steps of a chunk starting from a given one
+	auto take = [&](parse_chunk const& c, u32 from) {
+		for (auto i = from; i < c.decls.size(); ++i) {
+			if (c.decls[i]) {
+				result.push_back(c.decls[i]);
+			}
+		}
+		auto err_from = (from == 0) ? 0 : c.marks[from - 1];
+		errors.insert(errors.end(),
+			c.errors.begin() + err_from, c.errors.end());
+	};
+
+	take(chunks[0], 0);
+	// The index of the next token to parse
+	auto next = chunks[0].last;
+	for (u32 k = 1; k < n; ++k) {
+		auto const& c = chunks[k];
+		// If next is past the chunk, the chunk is skipped entirely
+		while (next < c.last) {
+			auto it = std::lower_bound(c.firsts.begin(), c.firsts.end(), next);
+			if (it != c.firsts.end() && *it == next) {
+				// Synchronized, the rest of the chunk is correct
+				take(c, u32(it - c.firsts.begin()));
+				next = c.last;
+				break;
+			}
+			// Wrong speculation, continue parsing serially
+			auto p = parser(toks, nodes, next);
+			auto mark = err::errors().size();
+			if (auto* d = p.decl()) {
+				result.push_back(d);
+			}
+			auto const& errs = err::errors();
+			errors.insert(errors.end(), errs.begin() + mark, errs.end());
+			err::truncate(mark);
+			next = p.index();
+		}
+	}
+
+	for (auto& c : chunks) {
+		nodes.adopt(*c.nodes);
+	}
+	for (auto& e : errors) {
+		err::report(std::move(e));
+	}
+	return result;
 }
 
 } /* namespace yk */
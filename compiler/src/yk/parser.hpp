@@ -10,38 +10,112 @@
 #ifndef YK_PARSER_HPP
 #define YK_PARSER_HPP
 
+#include <array>
 #include <optional>
 #include <vector>
+#include "arena.hpp"
 #include "ast.hpp"
 #include "lexer.hpp"
+#include "token_table.hpp"
 
 namespace yk {
 
+struct thread_pool;
+
 /**
  * The parser object itself. Takes a list of tokens and constructs an AST by the
- * language grammar.
+ * language grammar. The tokens either come from an already lexed vector, or
+ * they are pulled on demand from a token table or a lexer (streaming mode).
  */
 struct parser {
+	/**
+	 * The maximum number of tokens the parser can peek ahead.
+	 */
+	static constexpr u32 lookahead = 4;
+
 	/**
 	 * A utility function that parses a token source until the end and returns
 	 * the resulting global declaration list in a vector.
+	 * @param toks The tokens, ending with an EndOfFile token.
+	 * @param nodes The arena to allocate the AST in.
 	 * @return A vector of declaration statement nodes.
 	 */
-	static std::vector<stmt*> all(std::vector<token> const& toks);
+	static stmt_list all(std::vector<token> const& toks, arena& nodes);
+
+	/**
+	 * Parses a token vector in parallel. Every top-level declaration starts
+	 * with 'fn', so the tokens are split into chunks at those keywords, and the
+	 * chunks are parsed on the thread pool, speculating that each chunk starts
+	 * at a declaration. The chunks are then merged in order, parsing serially
+	 * where the speculation was wrong (like when the previous declaration
+	 * swallowed the 'fn'), until a declaration of the chunk is reached. The
+	 * resulting nodes and the reported errors are exactly the same as with the
+	 * serial parsing.
+	 * @param toks The tokens, ending with an EndOfFile token.
+	 * @param nodes The arena to allocate the AST in.
+	 * @param pool The thread pool to parse the chunks on.
+	 * @return A vector of declaration statement nodes.
+	 */
+	static stmt_list
+	all(std::vector<token> const& toks, arena& nodes, thread_pool& pool);
+
+	/**
+	 * A utility function that parses a token table until the end.
+	 * @param toks The table of tokens, ending with an EndOfFile token.
+	 * @param nodes The arena to allocate the AST in.
+	 * @return A vector of declaration statement nodes.
+	 */
+	static stmt_list all(token_table const& toks, arena& nodes);
+
+	/**
+	 * A utility function that lexes and parses in a single pass, without ever
+	 * building the token vector. Note, that the lexical errors are reported
+	 * interleaved with the syntax errors, in the order they are encountered.
+	 * @param lex The lexer to pull the tokens from.
+	 * @param nodes The arena to allocate the AST in.
+	 * @return A vector of declaration statement nodes.
+	 */
+	static stmt_list all(lexer& lex, arena& nodes);
 
 	/**
 	 * Creates a parser for a given token source.
 	 * @param toks The tokens to parse from.
+	 * @param nodes The arena to allocate the AST in.
+	 * @param start The index of the first token to parse (0 by default).
 	 */
-	explicit parser(std::vector<token> const& toks)
-		: m_Tokens(&toks), m_Index(0) {
+	parser(std::vector<token> const& toks, arena& nodes, u32 start = 0)
+		: m_Nodes(&nodes), m_Tokens(&toks), m_Index(start), m_Table(nullptr),
+		m_Lexer(nullptr), m_Head(0), m_Buffered(0) {
+	}
+
+	/**
+	 * Creates a parser for a token table. The table produces the tokens on
+	 * access, so they are pulled into the lookahead like from a lexer.
+	 * @param toks The table of tokens to parse from.
+	 * @param nodes The arena to allocate the AST in.
+	 * @param start The index of the first token to parse (0 by default).
+	 */
+	parser(token_table const& toks, arena& nodes, u32 start = 0)
+		: m_Nodes(&nodes), m_Tokens(nullptr), m_Index(start), m_Table(&toks),
+		m_Lexer(nullptr), m_Head(0), m_Buffered(0) {
+	}
+
+	/**
+	 * Creates a streaming parser, that pulls the tokens from a lexer when
+	 * needed. Only the lookahead is kept in memory.
+	 * @param lex The lexer to pull the tokens from.
+	 * @param nodes The arena to allocate the AST in.
+	 */
+	parser(lexer& lex, arena& nodes)
+		: m_Nodes(&nodes), m_Tokens(nullptr), m_Index(0), m_Table(nullptr),
+		m_Lexer(&lex), m_Head(0), m_Buffered(0) {
 	}
 
 	/**
 	 * Parses the global scope of the program, putting every node into a vector.
 	 * @return A list of global AST nodes.
 	 */
-	std::vector<stmt*> decl_list();
+	stmt_list decl_list();
 
 	/**
 	 * Parses a declaration.
@@ -56,27 +130,55 @@ struct parser {
 	 */
 	std::optional<expr::block> block();
 
+	/**
+	 * Checks if we have reached the end of the token input. Note, that the
+	 * input is required to have an EOF token at the end, meaning that this
+	 * function returns true, when the next token is the EOF.
+	 * @return True, if end of token input.
+	 */
+	bool is_eof() const;
+
+	/**
+	 * Returns the index of the next token to consume. Not available in
+	 * streaming mode from a lexer.
+	 * @return The index of the next token in the token vector or table.
+	 */
+	u32 index() const;
+
 private:
 	/**
 	 * Peeks the next token. If it's type matches the given one, it gets
 	 * consumed. And returned.
 	 * @param tag The token type to match the next token against.
-	 * @return A pointer to the consumed token or nullptr if didn't match.
+	 * @return The consumed token or nullopt if didn't match.
 	 */
-	token const* match(token::type_t tag);
+	std::optional<token> match(token::type_t tag);
 
 	/**
-	 * Peeks the next token and consumes it. If it does not match a given token
-	 * type, an unexpected token error is raised.
+	 * Peeks the next token and consumes it, if it matches a given token type.
+	 * Otherwise an expected token error is raised and nothing is consumed.
 	 * @param tag The token type to match the next token against.
 	 * @param desc The description of the expected token.
-	 * @return A pointer to the consumed token or nullptr if didn't match.
+	 * @return The consumed token or nullopt if didn't match.
+	 */
+	std::optional<token> expect(token::type_t tag, char const* desc);
+
+	/**
+	 * Recovers from an error inside a declaration (panic mode). Skips the
+	 * tokens until a synchronization point: the next 'fn' (not consumed) or a
+	 * '}' (consumed, as it most likely closes the broken function). No errors
+	 * are reported while skipping, so a broken declaration produces a single
+	 * error.
+	 * @return Always nullptr, so the caller can return it as the failed
+	 * declaration.
 	 */
-	token const* expect(token::type_t tag, char const* desc);
+	stmt* recover();
 
 	/**
-	 * Peeks (but does not consume) forward in the token source.
-	 * @param delta The amount to peek forward (1 by default).
+	 * Peeks (but does not consume) forward in the token source. In streaming
+	 * mode the returned reference is only valid until the next consume.
+	 * @param delta The amount to peek forward (0 by default). Must be less than
+	 * the lookahead.
 	 * @return The peeked token.
 	 */
 	token const& peek(u32 delta = 0) const;
@@ -85,18 +187,27 @@ private:
 	 * Consumes the next token.
 	 * @return The consumed token.
 	 */
-	token const& consume();
+	token consume();
 
 	/**
-	 * Checks if we have reached the end of the token input. Note, that the
-	 * input is required to have an EOF token at the end, meaning that this
-	 * function returns true, when index >= tokens.size() - 1.
-	 * @return True, if end of token input.
+	 * Pulls the next token from the token table or the lexer.
+	 * @return The next token.
 	 */
-	bool is_eof() const;
+	token pull() const;
 
+	// Every node and node list is allocated here
+	arena* m_Nodes;
+	// Vector mode, in table mode m_Index is the next token to pull (it goes
+	// one past the EOF token, when that is pulled)
 	std::vector<token> const* m_Tokens;
-	u32 m_Index;
+	mutable u32 m_Index;
+	// Streaming mode, the lookahead is a ring buffer filled from the table or
+	// the lexer
+	token_table const* m_Table;
+	lexer* m_Lexer;
+	mutable std::array<std::optional<token>, lookahead> m_Ring;
+	mutable u32 m_Head;
+	mutable u32 m_Buffered;
 };
 
 } /* namespace yk */
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <string>
+#include "profile.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace yk {
+
+char const* phase_name(phase p) {
+	switch (p) {
+	case phase::Read: return "read";
+	case phase::Cache: return "cache";
+	case phase::Lex: return "lexer::all";
+	case phase::Parse: return "parser::all";
+	case phase::Diagnostics: return "diagnostics";
+	}
+	yk_unreachable;
+	return "";
+}
+
+void phase_stats::add(phase_stats const& other) {
+	wall += other.wall;
+	cpu += other.cpu;
+	bytes += other.bytes;
+	allocations += other.allocations;
+	peak_rss = std::max(peak_rss, other.peak_rss);
+}
+
+double thread_cpu_time() {
+#ifdef _WIN32
+	// Only the process time is available portably
+	return double(std::clock()) / CLOCKS_PER_SEC;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+void worker_costs::run(std::function<void()> const& call) {
+	auto allocs = thread_allocations();
+	auto bytes = thread_allocated_bytes();
+	auto cpu = thread_cpu_time();
+	call();
+	auto guard = std::lock_guard<std::mutex>(m_Mutex);
+	m_Cpu += thread_cpu_time() - cpu;
+	m_Bytes += thread_allocated_bytes() - bytes;
+	m_Allocations += thread_allocations() - allocs;
+}
+
+void worker_costs::add_to(phase_stats& stats) {
+	auto guard = std::lock_guard<std::mutex>(m_Mutex);
+	stats.cpu += m_Cpu;
+	stats.bytes += m_Bytes;
+	stats.allocations += m_Allocations;
+}
+
+u64 peak_rss() {
+#ifdef _WIN32
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return u64(usage.ru_maxrss);
+#else
+	// Kilobytes on Linux
+	return u64(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+void write_profile_line(std::ostream& os, phase_profile const& prof) {
+	for (std::size_t i = 0; i < phase_count; ++i) {
+		auto const& s = prof[i];
+		os << (i ? ", " : "") << phase_name(phase(i)) << ' '
+			<< s.wall * 1000.0 << " ms/" << s.allocations << " allocs";
+	}
+}
+
+void write_profile_table(std::ostream& os, phase_profile const& prof) {
+	auto row = [&](char const* name, phase_stats const& s) {
+		os << "  " << std::left << std::setw(14) << name << std::right
+			<< std::setw(12) << s.wall * 1000.0
+			<< std::setw(12) << s.cpu * 1000.0
+			<< std::setw(14) << s.allocations
+			<< std::setw(16) << s.bytes
+			<< std::setw(14) << s.peak_rss / 1024 << '\n';
+	};
+	auto flags = os.flags();
+	auto precision = os.precision();
+	os << std::fixed << std::setprecision(3)
+		<< "  " << std::left << std::setw(14) << "phase" << std::right
+		<< std::setw(12) << "wall ms"
+		<< std::setw(12) << "cpu ms"
+		<< std::setw(14) << "allocations"
+		<< std::setw(16) << "bytes"
+		<< std::setw(14) << "peak RSS KB" << '\n';
+	auto total = phase_stats();
+	for (std::size_t i = 0; i < phase_count; ++i) {
+		row(phase_name(phase(i)), prof[i]);
+		total.add(prof[i]);
+	}
+	row("total", total);
+	os.flags(flags);
+	os.precision(precision);
+}
+
+/**
+ * Writes a string as a JSON string literal.
+ * @param os The stream to write to.
+ * @param str The string to write.
+ */
+static void write_json_string(std::ostream& os, std::string const& str) {
+	os << '"';
+	for (char c : str) {
+		switch (c) {
+		case '"': os << "\\\""; break;
+		case '\\': os << "\\\\"; break;
+		case '\n': os << "\\n"; break;
+		case '\r': os << "\\r"; break;
+		case '\t': os << "\\t"; break;
+		default:
+			if (u8(c) < 0x20) {
+				char buf[8];
+				std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(u8(c)));
+				os << buf;
+			}
+			else {
+				os << c;
+			}
+		}
+	}
+	os << '"';
+}
+
+/**
+ * Writes a profile as a JSON object, with a member for every phase.
+ * @param os The stream to write to.
+ * @param prof The profile.
+ */
+static void write_json_profile(std::ostream& os, phase_profile const& prof) {
+	os << '{';
+	for (std::size_t i = 0; i < phase_count; ++i) {
+		auto const& s = prof[i];
+		os << (i ? "," : "") << '"' << phase_name(phase(i)) << "\":{"
+			<< "\"wall_ms\":" << s.wall * 1000.0
+			<< ",\"cpu_ms\":" << s.cpu * 1000.0
+			<< ",\"allocations\":" << s.allocations
+			<< ",\"bytes\":" << s.bytes
+			<< ",\"peak_rss\":" << s.peak_rss << '}';
+	}
+	os << '}';
+}
+
+void write_profile_json(std::ostream& os,
+	std::vector<std::filesystem::path> const& files,
+	std::vector<phase_profile> const& profiles,
+	phase_profile const& total, double seconds) {
+	auto precision = os.precision();
+	os << std::setprecision(6)
+		<< "{\"wall_ms\":" << seconds * 1000.0
+		<< ",\"peak_rss\":" << peak_rss()
+		<< ",\"total\":";
+	write_json_profile(os, total);
+	os << ",\"files\":[";
+	for (std::size_t i = 0; i < files.size(); ++i) {
+		os << (i ? "," : "") << "{\"path\":";
+		write_json_string(os, files[i].generic_string());
+		os << ",\"phases\":";
+		write_json_profile(os, profiles[i]);
+		os << '}';
+	}
+	os << "]}\n";
+	os.precision(precision);
+}
+
+} /* namespace yk */
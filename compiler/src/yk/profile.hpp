@@ -0,0 +1,161 @@
+/**
+ * profile.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Measurement of the phases of the command line compiler: time,
+ * allocations and memory usage.
+ */
+
+#ifndef YK_PROFILE_HPP
+#define YK_PROFILE_HPP
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "alloc_counter.hpp"
+#include "common.hpp"
+#include "thread_pool.hpp"
+
+namespace yk {
+
+/**
+ * The measured phases of compiling a file.
+ */
+enum class phase : u8 {
+	Read,			// Mapping the file and copying it into the source
+	Cache,			// Looking up and storing the cache file
+	Lex,			// Lexing (or restoring the tokens)
+	Parse,			// Parsing (or restoring the AST)
+	Diagnostics,	// Formatting the errors
+};
+
+static constexpr std::size_t phase_count = 5;
+
+/**
+ * Returns the name of a phase, as it's shown in the reports.
+ * @param p The phase.
+ * @return The name of the phase.
+ */
+char const* phase_name(phase p);
+
+/**
+ * The cost of a phase. Allocations and CPU time are counted on the thread that
+ * runs the phase, so phases running in parallel don't disturb each other. The
+ * calls the phase hands to the workers of a thread pool are counted on the
+ * workers and added to it.
+ */
+struct phase_stats {
+	double wall = 0.0; // Seconds
+	double cpu = 0.0; // Seconds
+	u64 bytes = 0; // The allocated bytes
+	u64 allocations = 0;
+	u64 peak_rss = 0; // The peak resident size of the process after the phase
+
+	/**
+	 * Adds the costs of another measurement. The peak is the maximum of the
+	 * two peaks.
+	 * @param other The measurement to add.
+	 */
+	void add(phase_stats const& other);
+};
+
+/**
+ * The costs of every phase, indexed by the phase.
+ */
+using phase_profile = std::array<phase_stats, phase_count>;
+
+/**
+ * Returns the CPU time used by the calling thread so far.
+ * @return The CPU time in seconds.
+ */
+double thread_cpu_time();
+
+/**
+ * Returns the peak resident set size of the process so far.
+ * @return The peak in bytes, 0 if not supported on the platform.
+ */
+u64 peak_rss();
+
+/**
+ * Counts the CPU time and allocations of the calls that the workers of a
+ * thread pool take over from a phase.
+ */
+struct worker_costs final : thread_pool::observer {
+	void run(std::function<void()> const& call) override;
+
+	/**
+	 * Adds the counted costs to the measurement of the phase.
+	 * @param stats The measurement to add to.
+	 */
+	void add_to(phase_stats& stats);
+
+private:
+	std::mutex m_Mutex;
+	double m_Cpu = 0.0;
+	u64 m_Bytes = 0;
+	u64 m_Allocations = 0;
+};
+
+/**
+ * Runs a phase, adding it's costs to the profile.
+ * @param prof The profile to add to.
+ * @param p The phase to measure.
+ * @param fn The function executing the phase.
+ */
+template <typename Fn>
+void measure(phase_profile& prof, phase p, Fn&& fn) {
+	auto allocs = thread_allocations();
+	auto bytes = thread_allocated_bytes();
+	auto cpu = thread_cpu_time();
+	auto workers = worker_costs();
+	auto start = std::chrono::steady_clock::now();
+	{
+		auto observe = thread_pool::scoped_observer(workers);
+		fn();
+	}
+	auto end = std::chrono::steady_clock::now();
+	auto stats = phase_stats();
+	stats.wall = std::chrono::duration<double>(end - start).count();
+	stats.cpu = thread_cpu_time() - cpu;
+	stats.bytes = thread_allocated_bytes() - bytes;
+	stats.allocations = thread_allocations() - allocs;
+	workers.add_to(stats);
+	stats.peak_rss = peak_rss();
+	prof[std::size_t(p)].add(stats);
+}
+
+/**
+ * Writes the one-line summary of a file's profile.
+ * @param os The stream to write to.
+ * @param prof The profile of the file.
+ */
+void write_profile_line(std::ostream& os, phase_profile const& prof);
+
+/**
+ * Writes a table of every measurement of a profile.
+ * @param os The stream to write to.
+ * @param prof The profile.
+ */
+void write_profile_table(std::ostream& os, phase_profile const& prof);
+
+/**
+ * Writes the profiles as JSON, for tracking them over time.
+ * @param os The stream to write to.
+ * @param files The compiled files.
+ * @param profiles The profiles of the files, in the same order.
+ * @param total The aggregated profile.
+ * @param seconds The wall time of the whole run.
+ */
+void write_profile_json(std::ostream& os,
+	std::vector<std::filesystem::path> const& files,
+	std::vector<phase_profile> const& profiles,
+	phase_profile const& total, double seconds);
+
+} /* namespace yk */
+
+#endif /* YK_PROFILE_HPP */
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include "relexer.hpp"
+
+namespace yk {
+
+relex_result merge(relex_result const& first, relex_result const& second, u32 size) {
+	auto mid_size = size - first.removed + first.inserted;
+	auto end_size = mid_size - second.removed + second.inserted;
+	// The tokens before both spans and after both spans are untouched, the
+	// tail is counted from the end, as it's shifted by the edits
+	auto head = std::min(first.first, second.first);
+	auto tail = std::min(
+		mid_size - first.first - first.inserted,
+		mid_size - second.first - second.removed);
+	return relex_result{ head, size - head - tail, end_size - head - tail };
+}
+
+/**
+ * Returns the starting position of an error.
+ * @param e The error.
+ * @return The position, where the error's range starts.
+ */
+static position error_start(err::error_t const& e) {
+	return std::visit([](auto const& x) { return x.err_range().start(); }, e);
+}
+
+/**
+ * Moves a lexical error to a different position.
+ * @param e The error to move.
+ * @param shift The function that maps the old position to the new one.
+ * @return The moved error.
+ */
+template <typename Fn>
+static err::error_t shifted(err::error_t const& e, Fn&& shift) {
+	return match(e)(
+		[&](err::unclosed_comment const& x) -> err::error_t {
+			return err::unclosed_comment(shift(x.pos()), x.depth());
+		},
+		[&](err::unexpected_char const& x) -> err::error_t {
+			return err::unexpected_char(shift(x.pos()), x.character());
+		},
+		[](auto const& x) -> err::error_t {
+			// Parser errors are never stored here
+			yk_unreachable;
+			return x;
+		}
+	);
+}
+
+relexer::relexer(interner& syms)
+	: m_Symbols(&syms), m_Tokens(m_Source, syms) {
+	reset(source());
+}
+
+void relexer::reset(source&& src) {
+	auto mark = err::errors().size();
+	m_Source = std::move(src);
+	m_Tokens = token_table::lex(m_Source, *m_Symbols);
+	auto const& errs = err::errors();
+	m_Errors.assign(errs.begin() + mark, errs.end());
+}
+
+void relexer::restore(source&& src, token_table&& toks,
+	std::vector<err::error_t>&& errs) {
+	// The text is not copied when the source is moved, the tokens stay valid
+	m_Source = std::move(src);
+	m_Tokens = std::move(toks);
+	m_Errors = std::move(errs);
+	for (auto const& e : m_Errors) {
+		err::report(err::error_t(e));
+	}
+}
+
+u32 relexer::offset_of(position const& pos) const {
+	return m_Tokens.lines().offset_of(pos);
+}
+
+relex_result relexer::edit(range const& r, std::string_view text) {
+	auto from = offset_of(r.start());
+	auto to = std::max(from, offset_of(r.end()));
+	auto old_text = m_Source.text();
+	auto new_src = source({
+		old_text.substr(0, from), text, old_text.substr(to)
+	});
+	auto const* new_base = new_src.data();
+	// The byte shift of the text after the edit
+	auto delta = i64(text.size()) - i64(to - from);
+	// The end of the inserted text in the new source
+	auto edit_end = from + u32(text.size());
+
+	// Find the restart point, the last token that starts before the edit. Any
+	// token before that can't be affected by the edit.
+	u32 first = m_Tokens.lower_bound(from);
+	u32 restart_off = 0;
+	auto restart_pos = position::zero();
+	if (first > 0) {
+		--first;
+		restart_off = m_Tokens.offset(first);
+		restart_pos = m_Tokens.position_of(restart_off);
+	}
+
+	// Tokens before the restart point are unchanged, they have the same offset
+	// in the new source
+	auto toks = token_table(new_src, *m_Symbols);
+	toks.reserve(m_Tokens.size() + 16);
+	toks.append(m_Tokens, 0, first);
+
+	// Re-lex until we find a token past the edit, that starts at the same place
+	// as an old token. Lexing is deterministic from a token start, so from there
+	// on everything is the same as before, only shifted.
+	auto mark = err::errors().size();
+	auto lex = lexer(new_base + restart_off, restart_pos, *m_Symbols);
+	u32 old_idx = first;
+	bool synced = false;
+	auto new_sync = position::zero();
+	while (true) {
+		auto t = lex.next();
+		if (t.type() == token::EndOfFile) {
+			toks.push_back(t);
+			break;
+		}
+		auto off = u32(t.text().data() - new_base);
+		if (off >= edit_end) {
+			auto old_off = i64(off) - delta;
+			while (old_idx < m_Tokens.size()
+				&& m_Tokens.offset(old_idx) < old_off) {
+				++old_idx;
+			}
+			if (old_idx < m_Tokens.size()
+				&& m_Tokens.offset(old_idx) == old_off
+				&& m_Tokens.type(old_idx) == t.type()) {
+				synced = true;
+				new_sync = t.start();
+				break;
+			}
+		}
+		toks.push_back(t);
+	}
+	auto inserted = toks.size() - first;
+
+	// Errors of the re-lexed span. The errors of the synchronizing token itself
+	// (an unclosed comment) are kept from the old list.
+	auto const& errs = err::errors();
+	auto span_errs = std::vector<err::error_t>();
+	for (auto i = mark; i < errs.size(); ++i) {
+		if (!synced || error_start(errs[i]) < new_sync) {
+			span_errs.push_back(errs[i]);
+		}
+	}
+	err::truncate(mark);
+
+	auto new_errs = std::vector<err::error_t>();
+	for (auto const& e : m_Errors) {
+		if (error_start(e) < restart_pos) {
+			new_errs.push_back(e);
+		}
+	}
+	new_errs.insert(new_errs.end(),
+		std::make_move_iterator(span_errs.begin()),
+		std::make_move_iterator(span_errs.end()));
+
+	u32 removed = u32(m_Tokens.size()) - first;
+	if (synced) {
+		removed = old_idx - first;
+		// Everything from the synchronizing token is shifted. Positions on the
+		// same row as the synchronizing token are shifted in both directions,
+		// on later rows only vertically.
+		auto old_sync = m_Tokens.position_of(m_Tokens.offset(old_idx));
+		auto shift = [&](position const& p) {
+			if (p.row() == old_sync.row()) {
+				return position::row_col(new_sync.row(),
+					p.column() - old_sync.column() + new_sync.column());
+			}
+			return position::row_col(
+				p.row() - old_sync.row() + new_sync.row(), p.column());
+		};
+		// The tokens only store offsets, the positions come from the new source
+		toks.append(m_Tokens, old_idx, m_Tokens.size(), delta);
+		for (auto const& e : m_Errors) {
+			if (error_start(e) >= old_sync) {
+				new_errs.push_back(shifted(e, shift));
+			}
+		}
+	}
+
+	m_Source = std::move(new_src);
+	m_Tokens = std::move(toks);
+	m_Errors = std::move(new_errs);
+	for (auto const& e : m_Errors) {
+		err::report(err::error_t(e));
+	}
+	return relex_result{ first, removed, inserted };
+}
+
+} /* namespace yk */
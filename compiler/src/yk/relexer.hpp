@@ -0,0 +1,110 @@
+/**
+ * relexer.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Incremental lexical analysis, that keeps the tokens of a
+ * document up to date with textual edits without re-lexing everything.
+ */
+
+#ifndef YK_RELEXER_HPP
+#define YK_RELEXER_HPP
+
+#include <string_view>
+#include <vector>
+#include "common.hpp"
+#include "error.hpp"
+#include "interner.hpp"
+#include "lexer.hpp"
+#include "source.hpp"
+#include "token_table.hpp"
+
+namespace yk {
+
+/**
+ * Describes which part of the token list changed after an edit. The tokens
+ * [first, first + removed) of the old list were replaced by the tokens
+ * [first, first + inserted) of the new list, every other token is the same,
+ * but the ones after the span may have been shifted.
+ */
+struct relex_result {
+	u32 first;
+	u32 removed;
+	u32 inserted;
+};
+
+/**
+ * Merges the changes of two consecutive edits into one, so the consumers of
+ * the tokens can catch up with both at once. The result covers both spans,
+ * every token outside of it is unchanged by either edit.
+ * @param first The change of the earlier edit.
+ * @param second The change of the later edit.
+ * @param size The number of tokens before the earlier edit.
+ * @return The change that takes the tokens before the earlier edit to the
+ * tokens after the later one.
+ */
+relex_result merge(relex_result const& first, relex_result const& second, u32 size);
+
+/**
+ * Owns a lexed document (source, tokens and lexical errors) and updates it
+ * incrementally as edits come in. Re-lexing restarts at the last token before
+ * the edit and stops as soon as the new token stream re-synchronizes with the
+ * old one. The tokens after that point are kept, only shifted.
+ */
+struct relexer {
+	/**
+	 * Creates an incremental lexer with an empty document.
+	 * @param syms The interner for the identifier names.
+	 */
+	explicit relexer(interner& syms);
+
+	/**
+	 * Replaces the whole document and lexes it from scratch. The lexical errors
+	 * are reported like with a full lexing.
+	 * @param src The new source text.
+	 */
+	void reset(source&& src);
+
+	/**
+	 * Replaces the whole document with one that was lexed before (like in a
+	 * previous session). The given lexical errors are reported.
+	 * @param src The new source text.
+	 * @param toks The tokens of the source, referring into it's text or an
+	 * identical copy of it that the table keeps alive (like a cache file).
+	 * @param errs The lexical errors of the source.
+	 */
+	void restore(source&& src, token_table&& toks, std::vector<err::error_t>&& errs);
+
+	/**
+	 * Applies an edit to the document and re-lexes the affected tokens. When
+	 * done, every lexical error of the new document is reported, just like a
+	 * full lexing would have.
+	 * @param r The replaced range in the current document.
+	 * @param text The text to insert in place of the range.
+	 * @return The description of the replaced token span.
+	 */
+	relex_result edit(range const& r, std::string_view text);
+
+	source const& src() const { return m_Source; }
+	token_table const& tokens() const { return m_Tokens; }
+	std::vector<err::error_t> const& errors() const { return m_Errors; }
+
+	/**
+	 * Converts a position to a byte offset in the current document, using the
+	 * line index of the document.
+	 * @param pos The position to convert. Positions outside of the text are
+	 * clamped to the end of the line or the end of the text.
+	 * @return The byte offset of the position.
+	 */
+	u32 offset_of(position const& pos) const;
+
+private:
+	interner* m_Symbols;
+	source m_Source;
+	token_table m_Tokens;
+	std::vector<err::error_t> m_Errors; // Lexical errors only
+};
+
+} /* namespace yk */
+
+#endif /* YK_RELEXER_HPP */
@@ -0,0 +1,278 @@
+#include <cstdint>
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define YK_SCAN_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define YK_SCAN_AVX2
+#define YK_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define YK_SCAN_AVX2
+#define YK_TARGET_AVX2
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#endif
+
+namespace yk {
+namespace scan {
+
+/**
+ * The scanned character classes. Each class tells for a character (or a vector
+ * of characters) if the scan has to stop there. The null-terminator must stop
+ * every class, that is what bounds the scans.
+ */
+
+struct blank_class {
+	static bool stops(u8 c) {
+		return !(c == ' ' || c == '\t');
+	}
+
+#ifdef YK_SCAN_SSE2
+	static u32 stops(__m128i v) {
+		auto keep = _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))
+		);
+		return ~u32(_mm_movemask_epi8(keep)) & 0xffff;
+	}
+#endif
+
+#ifdef YK_SCAN_AVX2
+	YK_TARGET_AVX2 static u32 stops(__m256i v) {
+		auto keep = _mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))
+		);
+		return ~u32(_mm256_movemask_epi8(keep));
+	}
+#endif
+};
+
+struct visible_class {
+	static bool stops(u8 c) {
+		return !is_visible(char(c));
+	}
+
+	// Bytes are compared as signed, so everything above 0x7f is negative and
+	// falls out of the [0x20; 0x7f) range.
+
+#ifdef YK_SCAN_SSE2
+	static __m128i keep(__m128i v) {
+		return _mm_or_si128(
+			_mm_and_si128(
+				_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)),
+				_mm_cmplt_epi8(v, _mm_set1_epi8(0x7f))
+			),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))
+		);
+	}
+
+	static u32 stops(__m128i v) {
+		return ~u32(_mm_movemask_epi8(keep(v))) & 0xffff;
+	}
+#endif
+
+#ifdef YK_SCAN_AVX2
+	YK_TARGET_AVX2 static __m256i keep(__m256i v) {
+		return _mm256_or_si256(
+			_mm256_and_si256(
+				_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x1f)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), v)
+			),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))
+		);
+	}
+
+	YK_TARGET_AVX2 static u32 stops(__m256i v) {
+		return ~u32(_mm256_movemask_epi8(keep(v)));
+	}
+#endif
+};
+
+struct comment_class {
+	static bool stops(u8 c) {
+		return visible_class::stops(c) || c == '/' || c == '*';
+	}
+
+#ifdef YK_SCAN_SSE2
+	static u32 stops(__m128i v) {
+		auto delim = _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('/')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('*'))
+		);
+		auto keep = _mm_andnot_si128(delim, visible_class::keep(v));
+		return ~u32(_mm_movemask_epi8(keep)) & 0xffff;
+	}
+#endif
+
+#ifdef YK_SCAN_AVX2
+	YK_TARGET_AVX2 static u32 stops(__m256i v) {
+		auto delim = _mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*'))
+		);
+		auto keep = _mm256_andnot_si256(delim, visible_class::keep(v));
+		return ~u32(_mm256_movemask_epi8(keep));
+	}
+#endif
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Class>
+static char const* scan_scalar(char const* src) {
+	while (!Class::stops(static_cast<u8>(*src))) {
+		++src;
+	}
+	return src;
+}
+
+// The vectorized scanners only ever do aligned loads. An aligned block can
+// never cross a page boundary, so reading the whole block that contains the
+// null-terminator is safe, even if it reaches past the end of the string.
+
+#ifdef YK_SCAN_SSE2
+/**
+ * Returns the index of the lowest set bit.
+ * @param mask The bitmask, must not be 0.
+ * @return The number of trailing zero bits.
+ */
+static u32 lowest_bit(u32 mask) {
+	yk_assert(mask != 0);
+#if defined(__GNUC__) || defined(__clang__)
+	return u32(__builtin_ctz(mask));
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return u32(idx);
+#else
+	u32 n = 0;
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		++n;
+	}
+	return n;
+#endif
+}
+
+template <typename Class>
+static char const* scan_sse2(char const* src) {
+	auto addr = reinterpret_cast<std::uintptr_t>(src);
+	auto const* block =
+		reinterpret_cast<__m128i const*>(addr & ~std::uintptr_t(15));
+	// Ignore the bytes before the starting point in the first block
+	u32 mask = Class::stops(_mm_load_si128(block)) & (~0u << (addr & 15));
+	while (mask == 0) {
+		++block;
+		mask = Class::stops(_mm_load_si128(block));
+	}
+	return reinterpret_cast<char const*>(block) + lowest_bit(mask);
+}
+#endif
+
+#ifdef YK_SCAN_AVX2
+template <typename Class>
+YK_TARGET_AVX2 static char const* scan_avx2(char const* src) {
+	auto addr = reinterpret_cast<std::uintptr_t>(src);
+	auto const* block =
+		reinterpret_cast<__m256i const*>(addr & ~std::uintptr_t(31));
+	// Ignore the bytes before the starting point in the first block
+	u32 mask = Class::stops(_mm256_load_si256(block)) & (~0u << (addr & 31));
+	while (mask == 0) {
+		++block;
+		mask = Class::stops(_mm256_load_si256(block));
+	}
+	return reinterpret_cast<char const*>(block) + lowest_bit(mask);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The set of scanner implementations for a given instruction set.
+ */
+struct scanner_set {
+	char const*(*blank)(char const*);
+	char const*(*visible)(char const*);
+	char const*(*comment)(char const*);
+};
+
+/**
+ * Checks if the processor (and the OS) supports the AVX2 instruction set.
+ * @return True, if AVX2 instructions can be executed.
+ */
+static bool has_avx2() {
+#if defined(YK_SCAN_AVX2) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#elif defined(YK_SCAN_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuidex(info, 1, 0);
+	// OSXSAVE and AVX
+	bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+	if (!os_avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Selects the best scanner implementations for the running processor.
+ * @return The set of scanner functions to use.
+ */
+static scanner_set select_scanners() {
+#ifdef YK_SCAN_AVX2
+	if (has_avx2()) {
+		return {
+			scan_avx2<blank_class>,
+			scan_avx2<visible_class>,
+			scan_avx2<comment_class>,
+		};
+	}
+#endif
+#ifdef YK_SCAN_SSE2
+	return {
+		scan_sse2<blank_class>,
+		scan_sse2<visible_class>,
+		scan_sse2<comment_class>,
+	};
+#else
+	return {
+		scan_scalar<blank_class>,
+		scan_scalar<visible_class>,
+		scan_scalar<comment_class>,
+	};
+#endif
+}
+
+static scanner_set const& scanners() {
+	static scanner_set const set = select_scanners();
+	return set;
+}
+
+char const* skip_blank(char const* src) {
+	// Most blank runs are a single space between tokens, don't bother with the
+	// vectorized path for those
+	if (!is_blank(src[0]) || !is_blank(src[1])) {
+		return scan_scalar<blank_class>(src);
+	}
+	return scanners().blank(src);
+}
+
+char const* skip_visible(char const* src) {
+	return scanners().visible(src);
+}
+
+char const* skip_comment_text(char const* src) {
+	return scanners().comment(src);
+}
+
+} /* namespace scan */
+} /* namespace yk */
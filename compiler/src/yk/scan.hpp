@@ -0,0 +1,67 @@
+/**
+ * scan.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Vectorized character-class scanners for skipping long runs of
+ * trivia (whitespace and comment text) in the lexer.
+ */
+
+#ifndef YK_SCAN_HPP
+#define YK_SCAN_HPP
+
+#include "common.hpp"
+
+namespace yk {
+namespace scan {
+
+/**
+ * Finds the first character that is not blank (space or horizontal tab).
+ * @param src The null-terminated source to scan from.
+ * @return A pointer to the first non-blank character. The null-terminator
+ * always stops the scan.
+ */
+char const* skip_blank(char const* src);
+
+/**
+ * Finds the first character that is not visible. Visible means graphical or
+ * blank, so these are the characters that occupy a column in the source.
+ * @param src The null-terminated source to scan from.
+ * @return A pointer to the first non-visible character (newlines, control
+ * characters, non-ASCII bytes or the null-terminator).
+ */
+char const* skip_visible(char const* src);
+
+/**
+ * Finds the first character that is either not visible, or could be part of a
+ * comment delimiter ('/' or '*'). Used to skip the body of nested comments.
+ * @param src The null-terminated source to scan from.
+ * @return A pointer to the first character that needs inspection.
+ */
+char const* skip_comment_text(char const* src);
+
+/**
+ * Checks if a character is blank (space or horizontal tab). Equivalent to
+ * std::isblank in the "C" locale, but without the locale lookup.
+ * @param ch The character to check.
+ * @return True, if the character is blank.
+ */
+inline bool is_blank(char ch) {
+	return ch == ' ' || ch == '\t';
+}
+
+/**
+ * Checks if a character is visible, meaning that it occupies a column.
+ * Equivalent to std::isgraph(ch) || std::isblank(ch) in the "C" locale.
+ * @param ch The character to check.
+ * @return True, if the character is visible.
+ */
+inline bool is_visible(char ch) {
+	auto c = static_cast<u8>(ch);
+	return (c >= 0x20 && c < 0x7f) || c == '\t';
+}
+
+} /* namespace scan */
+} /* namespace yk */
+
+#endif /* YK_SCAN_HPP */
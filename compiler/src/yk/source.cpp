@@ -0,0 +1,46 @@
+#include <cstring>
+#include "source.hpp"
+
+namespace yk {
+
+source::source(char const* text, std::size_t len)
+	: m_Text(std::make_unique<char[]>(len + 1)), m_Data(m_Text.get()),
+	m_Size(u32(len)) {
+	yk_assert(len < std::size_t(u32(-1)));
+	std::memcpy(m_Text.get(), text, len);
+	m_Text[len] = '\0';
+}
+
+source::source(std::initializer_list<std::string_view> parts)
+	: m_Size(0) {
+	std::size_t len = 0;
+	for (auto part : parts) {
+		len += part.size();
+	}
+	yk_assert(len < std::size_t(u32(-1)));
+	m_Text = std::make_unique<char[]>(len + 1);
+	m_Data = m_Text.get();
+	m_Size = u32(len);
+	auto* p = m_Text.get();
+	for (auto part : parts) {
+		std::memcpy(p, part.data(), part.size());
+		p += part.size();
+	}
+	*p = '\0';
+}
+
+source::source(mapped_file&& file)
+	: m_Data(nullptr), m_Size(0) {
+	if (file.size() == 0) {
+		// Empty files have no mapping to point into
+		*this = source();
+		return;
+	}
+	yk_assert(file.size() < std::size_t(u32(-1)));
+	m_Data = file.text().data();
+	yk_assert(m_Data[file.size()] == '\0');
+	m_Size = u32(file.size());
+	m_File = std::move(file);
+}
+
+} /* namespace yk */
@@ -0,0 +1,99 @@
+/**
+ * source.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description The owned source text of a compilation.
+ */
+
+#ifndef YK_SOURCE_HPP
+#define YK_SOURCE_HPP
+
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "common.hpp"
+#include "mapped_file.hpp"
+
+namespace yk {
+
+/**
+ * An owned, immutable, null-terminated source text. Tokens don't copy their
+ * text, they refer into this buffer instead, so the source has to outlive the
+ * tokens lexed from it. The text lives in a separate heap block or a mapping,
+ * meaning that moving the source object does not invalidate the tokens.
+ */
+struct source {
+	source(source const&) = delete;
+	source(source&&) = default;
+	source& operator=(source const&) = delete;
+	source& operator=(source&&) = default;
+
+	/**
+	 * Creates an empty source.
+	 */
+	source()
+		: source("", 0) {
+	}
+
+	/**
+	 * Creates a source by copying the given text.
+	 * @param text The text to copy. Can contain null characters, but the lexer
+	 * will stop at the first one.
+	 */
+	explicit source(std::string_view text)
+		: source(text.data(), text.size()) {
+	}
+
+	/**
+	 * Creates a source by copying the given text.
+	 * @param text The beginning of the text to copy.
+	 * @param len The length of the text in characters.
+	 */
+	explicit source(char const* text, std::size_t len);
+
+	/**
+	 * Creates a source by concatenating text fragments, like when an edit is
+	 * applied to a previous source text.
+	 * @param parts The fragments to concatenate.
+	 */
+	explicit source(std::initializer_list<std::string_view> parts);
+
+	/**
+	 * Creates a source from a mapped file without copying it. The file has to
+	 * be mapped with the terminating zero byte, the mapping is owned by the
+	 * source from now on.
+	 * @param file The mapped file.
+	 */
+	explicit source(mapped_file&& file);
+
+	/**
+	 * Returns the null-terminated text, that can be passed to the lexer.
+	 * @return The pointer to the first character of the text.
+	 */
+	char const* data() const { return m_Data; }
+
+	/**
+	 * Returns the length of the text (excluding the null-terminator).
+	 * @return The length of the text in characters.
+	 */
+	u32 size() const { return m_Size; }
+
+	/**
+	 * Returns a view of the whole text.
+	 * @return The view of the text (without the null-terminator).
+	 */
+	std::string_view text() const { return std::string_view(data(), size()); }
+
+private:
+	std::unique_ptr<char[]> m_Text;
+	std::optional<mapped_file> m_File;
+	char const* m_Data; // Either the owned text or the mapping
+	u32 m_Size;
+};
+
+} /* namespace yk */
+
+#endif /* YK_SOURCE_HPP */
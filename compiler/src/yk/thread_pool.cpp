@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "thread_pool.hpp"
+
+namespace yk {
+
+static thread_local thread_pool::observer* current_observer = nullptr;
+
+thread_pool::scoped_observer::scoped_observer(observer& obs)
+	: m_Previous(current_observer) {
+	current_observer = &obs;
+}
+
+thread_pool::scoped_observer::~scoped_observer() {
+	current_observer = m_Previous;
+}
+
+thread_pool::thread_pool(u32 threads)
+	: m_Stop(false) {
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	m_Workers.reserve(threads);
+	for (u32 i = 0; i < threads; ++i) {
+		m_Workers.emplace_back([this] { work(); });
+	}
+}
+
+thread_pool::~thread_pool() {
+	{
+		auto lock = std::unique_lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_Wake.notify_all();
+	for (auto& w : m_Workers) {
+		w.join();
+	}
+}
+
+void thread_pool::submit(std::function<void()>&& task) {
+	{
+		auto lock = std::unique_lock(m_Mutex);
+		m_Tasks.push_back(std::move(task));
+	}
+	m_Wake.notify_one();
+}
+
+void thread_pool::work() {
+	while (true) {
+		std::function<void()> task;
+		{
+			auto lock = std::unique_lock(m_Mutex);
+			m_Wake.wait(lock, [this] { return m_Stop || !m_Tasks.empty(); });
+			if (m_Tasks.empty()) {
+				// Stopped and drained
+				return;
+			}
+			task = std::move(m_Tasks.front());
+			m_Tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void thread_pool::for_each(u32 n, std::function<void(u32)> const& fn) {
+	if (n == 0) {
+		return;
+	}
+
+	// Indices are claimed one by one, by the helper tasks and by the caller, so
+	// the caller never blocks on tasks that nobody runs (even when it's a
+	// worker itself).
+	struct job {
+		std::atomic<u32> next{ 0 };
+		std::atomic<u32> remaining;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	auto state = std::make_shared<job>();
+	state->remaining = n;
+
+	// The observer has to see a call end before it's counted as done, as the
+	// caller (and the observer) can go away right after the last one
+	auto run = [state, n, &fn](observer* obs) {
+		while (true) {
+			auto i = state->next.fetch_add(1);
+			if (i >= n) {
+				return;
+			}
+			if (obs) {
+				obs->run([&] { fn(i); });
+			}
+			else {
+				fn(i);
+			}
+			if (state->remaining.fetch_sub(1) == 1) {
+				auto lock = std::unique_lock(state->mutex);
+				state->done.notify_all();
+			}
+		}
+	};
+
+	auto helpers = std::min(size(), n - 1);
+	auto* obs = current_observer;
+	for (u32 i = 0; i < helpers; ++i) {
+		submit([run, obs] { run(obs); });
+	}
+	run(nullptr);
+
+	auto lock = std::unique_lock(state->mutex);
+	state->done.wait(lock, [&] { return state->remaining == 0; });
+}
+
+} /* namespace yk */
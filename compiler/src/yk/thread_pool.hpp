@@ -0,0 +1,114 @@
+/**
+ * thread_pool.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description A simple thread pool for the parallel parts of the compiler.
+ */
+
+#ifndef YK_THREAD_POOL_HPP
+#define YK_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.hpp"
+
+namespace yk {
+
+/**
+ * A fixed set of worker threads that execute submitted tasks.
+ */
+struct thread_pool {
+	/**
+	 * Runs the calls of for_each that a worker takes over from a thread, so
+	 * they can be attributed to that thread. Installed with scoped_observer.
+	 */
+	struct observer {
+		virtual ~observer() = default;
+
+		/**
+		 * Runs a call on the worker that took it. Called concurrently from
+		 * the workers.
+		 * @param call The call to run.
+		 */
+		virtual void run(std::function<void()> const& call) = 0;
+	};
+
+	/**
+	 * Installs an observer for the for_each calls of the current thread,
+	 * until the object goes out of scope. Then the previous observer is
+	 * restored, so installations can be nested.
+	 */
+	struct scoped_observer {
+		/**
+		 * Installs an observer.
+		 * @param obs The observer of the calls taken over by the workers.
+		 */
+		explicit scoped_observer(observer& obs);
+
+		scoped_observer(scoped_observer const&) = delete;
+		scoped_observer& operator=(scoped_observer const&) = delete;
+
+		~scoped_observer();
+
+	private:
+		observer* m_Previous;
+	};
+
+	/**
+	 * Creates a thread pool.
+	 * @param threads The number of worker threads. If 0, the number of hardware
+	 * threads is used.
+	 */
+	explicit thread_pool(u32 threads = 0);
+
+	thread_pool(thread_pool const&) = delete;
+	thread_pool& operator=(thread_pool const&) = delete;
+
+	/**
+	 * Waits for the queued tasks to finish and stops the workers.
+	 */
+	~thread_pool();
+
+	/**
+	 * Returns the number of worker threads.
+	 * @return The number of workers.
+	 */
+	u32 size() const { return u32(m_Workers.size()); }
+
+	/**
+	 * Calls a function for every index in [0, n), distributed between the
+	 * workers and the calling thread. Returns when every call has finished.
+	 * The calls the workers run go through the observer of the calling
+	 * thread, if it has one.
+	 * @param n The number of indices.
+	 * @param fn The function to call with each index.
+	 */
+	void for_each(u32 n, std::function<void(u32)> const& fn);
+
+private:
+	/**
+	 * Enqueues a task for the workers.
+	 * @param task The task to execute.
+	 */
+	void submit(std::function<void()>&& task);
+
+	/**
+	 * The loop of a worker thread.
+	 */
+	void work();
+
+	std::vector<std::thread> m_Workers;
+	std::deque<std::function<void()>> m_Tasks;
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	bool m_Stop;
+};
+
+} /* namespace yk */
+
+#endif /* YK_THREAD_POOL_HPP */
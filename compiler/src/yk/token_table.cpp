@@ -0,0 +1,94 @@
+#include <algorithm>
+#include "token_table.hpp"
+
+namespace yk {
+
+token_table token_table::lex(source const& src, interner& syms) {
+	auto result = token_table(src, syms);
+	// Only the offsets are stored, the lexer doesn't have to track positions
+	auto lex = lexer(result.lines(), syms);
+	while (true) {
+		auto t = lex.next();
+		result.push_back(t);
+		if (t.type() == token::EndOfFile) {
+			return result;
+		}
+	}
+}
+
+token_table::token_table(source const& src, interner const& syms)
+	: m_Text(src.data()), m_Symbols(&syms), m_Lines(src) {
+}
+
+token_table::token_table(char const* text, interner const& syms,
+	u8 const* types, u32 const* offsets, u32 const* lengths, u32 count,
+	std::vector<symbol>&& names, std::shared_ptr<void const> owner)
+	: m_Text(text), m_Symbols(&syms), m_Types(types, count),
+	m_Offsets(offsets, count), m_Lengths(lengths, count),
+	m_Names(std::move(names)), m_Owner(std::move(owner)), m_Lines(text) {
+}
+
+void token_table::reserve(u32 n) {
+	m_Types.reserve(n);
+	m_Offsets.reserve(n);
+	m_Lengths.reserve(n);
+}
+
+void token_table::push_back(token const& tok) {
+	m_Types.push_back(u8(tok.type()));
+	m_Offsets.push_back(u32(tok.text().data() - m_Text));
+	m_Lengths.push_back((tok.type() == token::Identifier)
+		? tok.name().id() : u32(tok.text().size()));
+}
+
+void token_table::append(token_table const& other, u32 from, u32 to, i64 delta) {
+	m_Types.append(other.m_Types.data() + from, other.m_Types.data() + to);
+	auto first = m_Offsets.size();
+	m_Offsets.append(other.m_Offsets.data() + from, other.m_Offsets.data() + to);
+	if (delta != 0) {
+		auto* offsets = m_Offsets.begin_owned();
+		for (auto i = first; i < m_Offsets.size(); ++i) {
+			offsets[i] = u32(offsets[i] + delta);
+		}
+	}
+	if (other.m_Names.empty()) {
+		m_Lengths.append(other.m_Lengths.data() + from, other.m_Lengths.data() + to);
+		return;
+	}
+	// The name indices of a borrowed table are replaced by the symbols
+	m_Lengths.reserve(m_Lengths.size() + (to - from));
+	for (auto i = from; i < to; ++i) {
+		m_Lengths.push_back((other.type(i) == token::Identifier)
+			? other.name(i).id() : other.m_Lengths[i]);
+	}
+}
+
+token token_table::operator[](u32 i) const {
+	auto ty = type(i);
+	switch (ty) {
+	case token::LineComment:
+	case token::NestedComment:
+		return token(range_of(i), ty, text(i));
+
+	case token::Identifier:
+		return token(position_of(offset(i)), text(i), name(i));
+
+	default:
+		return token(position_of(offset(i)), ty, text(i));
+	}
+}
+
+u32 token_table::lower_bound(u32 off) const {
+	auto const* begin = m_Offsets.data();
+	return u32(std::lower_bound(begin, begin + m_Offsets.size(), off) - begin);
+}
+
+u32 token_table::find_at(u32 off) const {
+	auto i = lower_bound(off + 1);
+	if (i > 0 && off < offset(i - 1) + length(i - 1)) {
+		return i - 1;
+	}
+	return size();
+}
+
+} /* namespace yk */
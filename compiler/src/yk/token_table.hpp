@@ -0,0 +1,357 @@
+/**
+ * token_table.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Compact, struct-of-arrays storage for the tokens of a source.
+ */
+
+#ifndef YK_TOKEN_TABLE_HPP
+#define YK_TOKEN_TABLE_HPP
+
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "common.hpp"
+#include "interner.hpp"
+#include "lexer.hpp"
+#include "line_index.hpp"
+#include "source.hpp"
+
+namespace yk {
+
+/**
+ * Stores the tokens of a source in separate dense arrays: the types, the start
+ * offsets and the lengths (9 bytes per token). Identifiers store their symbol
+ * instead of the length, as the length is the length of the interned name.
+ * Positions are not stored, they are calculated from the line index of the
+ * source on access. Indexing and iterating produces full token values, so everything
+ * that works with a token vector can work with the table.
+ *
+ * The arrays can also be borrowed from memory the table doesn't own, like a
+ * mapped cache file. Then nothing is copied, identifiers store the index of
+ * their name in a small name table, that maps to the symbols. Borrowed tables
+ * can't be appended to, edits build a new table anyway.
+ */
+struct token_table {
+	/**
+	 * Helper for the arrow operator of the iterator, as the tokens are produced
+	 * on access.
+	 */
+	struct arrow {
+		token const* operator->() const { return &m_Token; }
+
+		token m_Token;
+	};
+
+	/**
+	 * A random-access iterator, that produces the tokens by value.
+	 */
+	struct iterator {
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = token;
+		using difference_type = std::ptrdiff_t;
+		using pointer = arrow;
+		using reference = token;
+
+		iterator()
+			: m_Table(nullptr), m_Index(0) {
+		}
+
+		explicit iterator(token_table const* table, u32 index)
+			: m_Table(table), m_Index(index) {
+		}
+
+		u32 index() const { return m_Index; }
+
+		token operator*() const { return (*m_Table)[m_Index]; }
+		arrow operator->() const { return arrow{ **this }; }
+		token operator[](difference_type n) const { return *(*this + n); }
+
+		iterator& operator++() { ++m_Index; return *this; }
+		iterator& operator--() { --m_Index; return *this; }
+		iterator operator++(int) { auto it = *this; ++m_Index; return it; }
+		iterator operator--(int) { auto it = *this; --m_Index; return it; }
+		iterator& operator+=(difference_type n) {
+			m_Index = u32(m_Index + n);
+			return *this;
+		}
+		iterator& operator-=(difference_type n) {
+			m_Index = u32(m_Index - n);
+			return *this;
+		}
+		iterator operator+(difference_type n) const { return iterator(*this) += n; }
+		iterator operator-(difference_type n) const { return iterator(*this) -= n; }
+		difference_type operator-(iterator const& o) const {
+			return difference_type(m_Index) - difference_type(o.m_Index);
+		}
+
+		bool operator==(iterator const& o) const { return m_Index == o.m_Index; }
+		bool operator!=(iterator const& o) const { return m_Index != o.m_Index; }
+		bool operator<(iterator const& o) const { return m_Index < o.m_Index; }
+		bool operator<=(iterator const& o) const { return m_Index <= o.m_Index; }
+		bool operator>(iterator const& o) const { return m_Index > o.m_Index; }
+		bool operator>=(iterator const& o) const { return m_Index >= o.m_Index; }
+
+	private:
+		token_table const* m_Table;
+		u32 m_Index;
+	};
+
+	/**
+	 * Lexes a whole owned source into a table (including the EndOfFile token).
+	 * The table refers into the source, so it has to outlive the table.
+	 * @param src The source to lex.
+	 * @param syms The interner for the identifier names.
+	 * @return The table of tokens.
+	 */
+	static token_table lex(source const& src, interner& syms);
+
+	/**
+	 * Creates an empty table for a source. The line index of the source is
+	 * built here.
+	 * @param src The source the tokens will refer into. Only the text is
+	 * referenced, so the source object itself can be moved.
+	 * @param syms The interner the identifier names are interned in.
+	 */
+	explicit token_table(source const& src, interner const& syms);
+
+	/**
+	 * Creates a table over borrowed arrays.
+	 * @param text The null-terminated text the offsets refer into.
+	 * @param syms The interner of the names.
+	 * @param types The token types.
+	 * @param offsets The start offsets of the tokens.
+	 * @param lengths The lengths of the tokens, or the index of the name in
+	 * the names for identifiers.
+	 * @param count The number of tokens in the arrays.
+	 * @param names The symbols of the names.
+	 * @param owner Keeps the text and the arrays alive while any copy of the
+	 * table exists.
+	 */
+	token_table(char const* text, interner const& syms,
+		u8 const* types, u32 const* offsets, u32 const* lengths, u32 count,
+		std::vector<symbol>&& names, std::shared_ptr<void const> owner);
+
+	/**
+	 * Reserves space for a number of tokens.
+	 * @param n The number of tokens.
+	 */
+	void reserve(u32 n);
+
+	/**
+	 * Appends a token to the end of the table.
+	 * @param tok The token to append, it has to refer into the source of the
+	 * table.
+	 */
+	void push_back(token const& tok);
+
+	/**
+	 * Appends a token by it's stored fields, without creating a token value.
+	 * Used to restore a table that was lexed before, like from a cache.
+	 * @param ty The type of the token.
+	 * @param offset The offset of the token text in the source.
+	 * @param length The length of the token text, or the symbol ID for
+	 * identifiers.
+	 */
+	void push_back(token::type_t ty, u32 offset, u32 length) {
+		m_Types.push_back(u8(ty));
+		m_Offsets.push_back(offset);
+		m_Lengths.push_back(length);
+	}
+
+	/**
+	 * Appends a span of tokens from another table, moving them by a number of
+	 * bytes. Used to keep the unchanged tokens after an edit.
+	 * @param other The table to copy from, with the same interner.
+	 * @param from The index of the first token to copy.
+	 * @param to The index after the last token to copy.
+	 * @param delta The amount to add to the offsets.
+	 */
+	void append(token_table const& other, u32 from, u32 to, i64 delta = 0);
+
+	u32 size() const { return m_Types.size(); }
+	bool empty() const { return m_Types.size() == 0; }
+
+	token::type_t type(u32 i) const { return token::type_t(m_Types[i]); }
+	u32 offset(u32 i) const { return m_Offsets[i]; }
+
+	/**
+	 * Returns the length of a token in characters.
+	 * @param i The index of the token.
+	 * @return The length of the token's text.
+	 */
+	u32 length(u32 i) const {
+		if (type(i) == token::Identifier) {
+			return u32(m_Symbols->str(name(i)).size());
+		}
+		return m_Lengths[i];
+	}
+
+	/**
+	 * Returns the name of a token.
+	 * @param i The index of the token.
+	 * @return The symbol for identifiers, an invalid symbol otherwise.
+	 */
+	symbol name(u32 i) const {
+		if (type(i) != token::Identifier) {
+			return symbol();
+		}
+		return m_Names.empty() ? symbol(m_Lengths[i]) : m_Names[m_Lengths[i]];
+	}
+
+	std::string_view text(u32 i) const {
+		return std::string_view(m_Text + offset(i), length(i));
+	}
+
+	range range_of(u32 i) const {
+		return range(position_of(offset(i)), position_of(offset(i) + length(i)));
+	}
+
+	/**
+	 * Creates the full token at an index.
+	 * @param i The index of the token.
+	 * @return The token value.
+	 */
+	token operator[](u32 i) const;
+
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, size()); }
+
+	/**
+	 * Returns the type array, that can be scanned quickly.
+	 * @return The pointer to the first token type.
+	 */
+	u8 const* types() const { return m_Types.data(); }
+
+	/**
+	 * Calls a function with the index of every token of a given type, in order.
+	 * The type array is searched with memchr, that is vectorized.
+	 * @param ty The type of tokens to look for.
+	 * @param fn The function to call with the token indices. If it returns a
+	 * bool, returning false stops the iteration.
+	 */
+	template <typename Fn>
+	void for_each_of(token::type_t ty, Fn&& fn) const {
+		auto const* base = m_Types.data();
+		auto const* end = base + m_Types.size();
+		for (auto const* p = base; p < end; ++p) {
+			p = static_cast<u8 const*>(std::memchr(p, int(ty), end - p));
+			if (!p) {
+				return;
+			}
+			if constexpr (std::is_same_v<std::invoke_result_t<Fn&, u32>, bool>) {
+				if (!fn(u32(p - base))) {
+					return;
+				}
+			}
+			else {
+				fn(u32(p - base));
+			}
+		}
+	}
+
+	/**
+	 * Finds the first token that starts at or after an offset.
+	 * @param off The offset to search for.
+	 * @return The index of the token, or the size of the table if there is no
+	 * such token.
+	 */
+	u32 lower_bound(u32 off) const;
+
+	/**
+	 * Finds the token that contains an offset.
+	 * @param off The offset to search for.
+	 * @return The index of the token, or the size of the table if the offset
+	 * is not inside of a token.
+	 */
+	u32 find_at(u32 off) const;
+
+	/**
+	 * Converts a byte offset in the source to a position.
+	 * @param off The offset to convert.
+	 * @return The position of the offset.
+	 */
+	position position_of(u32 off) const { return m_Lines.position_of(off); }
+
+	line_index const& lines() const { return m_Lines; }
+
+private:
+	/**
+	 * One of the arrays. It's either owned, or borrowed, reading goes through
+	 * the pointer in both cases.
+	 */
+	template <typename T>
+	struct column {
+		column()
+			: m_Data(nullptr), m_Size(0) {
+		}
+
+		column(T const* data, u32 size)
+			: m_Data(data), m_Size(size) {
+		}
+
+		column(column const& o)
+			: m_Owned(o.m_Owned), m_Data(o.owned() ? m_Owned.data() : o.m_Data),
+			m_Size(o.m_Size) {
+		}
+
+		// Moving the vector keeps it's buffer, so the pointer stays valid
+		column(column&&) = default;
+		column& operator=(column&&) = default;
+
+		column& operator=(column const& o) {
+			return *this = column(o);
+		}
+
+		bool owned() const { return m_Data == m_Owned.data(); }
+
+		T const* data() const { return m_Data; }
+		u32 size() const { return m_Size; }
+		T const& operator[](u32 i) const { return m_Data[i]; }
+
+		void reserve(u32 n) {
+			yk_assert(owned());
+			m_Owned.reserve(n);
+			m_Data = m_Owned.data();
+		}
+
+		void push_back(T val) {
+			yk_assert(owned());
+			m_Owned.push_back(val);
+			m_Data = m_Owned.data();
+			++m_Size;
+		}
+
+		void append(T const* first, T const* last) {
+			yk_assert(owned());
+			m_Owned.insert(m_Owned.end(), first, last);
+			m_Data = m_Owned.data();
+			m_Size = u32(m_Owned.size());
+		}
+
+		T* begin_owned() { return m_Owned.data(); }
+
+	private:
+		std::vector<T> m_Owned;
+		T const* m_Data;
+		u32 m_Size;
+	};
+
+	char const* m_Text;
+	interner const* m_Symbols;
+	column<u8> m_Types;
+	column<u32> m_Offsets;
+	column<u32> m_Lengths; // Symbol IDs or name indices for identifiers
+	// Only for borrowed tables, the symbols of the name indices
+	std::vector<symbol> m_Names;
+	std::shared_ptr<void const> m_Owner;
+	line_index m_Lines;
+};
+
+} /* namespace yk */
+
+#endif /* YK_TOKEN_TABLE_HPP */
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <yk/cache.hpp>
+#include <yk/compilation.hpp>
+#include <yk/error.hpp>
+#include <yk/lexer.hpp>
+#include <yk/relexer.hpp>
+#include <yk/source.hpp>
+#include <yk/thread_pool.hpp>
+#include <yk/token_table.hpp>
+
+// Every shortcut of the compiler has to give exactly the same tokens, trees
+// and errors, as lexing and parsing the whole text from scratch, and so does
+// restoring them from the cache. The texts and the edits are random, but
+// seeded, so a failure can be reproduced.
+
+using namespace yk;
+
+// The fragments the texts are built from, that break and fix declarations and
+// comments when inserted anywhere. The line breaks, control and non-ASCII
+// bytes move the rows and columns of everything after them
+static char const* const pieces[] = {
+	"fn ", "foo", "()", " foreign;", "{", "}", "\n", " ", "$", "bar_1", ";",
+	"/*", "*/", "// line\n", "fn x() {\n}\n", "fn y() foreign;\n",
+	"\r\n", "\r", "\t", "\x01", "\x7f", "\xc3\xa9", "\xff",
+};
+
+static u32 failures = 0;
+
+static std::string random_text(std::mt19937& rnd, u32 count) {
+	auto text = std::string();
+	for (u32 i = 0; i < count; ++i) {
+		text += pieces[rnd() % std::size(pieces)];
+	}
+	return text;
+}
+
+static std::string dump_range(range const& r) {
+	return std::to_string(r.start().row()) + ':' + std::to_string(r.start().column())
+		+ '-' + std::to_string(r.end().row()) + ':' + std::to_string(r.end().column());
+}
+
+static std::string_view name_of(symbol sym, interner const& syms) {
+	// Only identifiers have names
+	return sym.is_valid() ? syms.str(sym) : std::string_view();
+}
+
+static std::string dump(std::vector<err::error_t> const& errs) {
+	auto out = std::ostringstream();
+	for (auto const& e : errs) {
+		out << "error " << dump_range(err::error_range(e)) << ' ' << err::message(e) << '\n';
+	}
+	return out.str();
+}
+
+static std::string dump(token_table const& toks, interner const& syms) {
+	auto out = std::ostringstream();
+	for (u32 i = 0; i < toks.size(); ++i) {
+		out << u32(toks.type(i)) << ' ' << toks.offset(i) << '+' << toks.length(i)
+			<< ' ' << name_of(toks.name(i), syms) << '\n';
+	}
+	return out.str();
+}
+
+static std::string dump(std::vector<token> const& toks, interner const& syms) {
+	auto out = std::ostringstream();
+	for (auto const& tok : toks) {
+		out << u32(tok.type()) << ' ' << dump_range(tok.range_()) << ' '
+			<< name_of(tok.name(), syms) << '\n';
+	}
+	return out.str();
+}
+
+static std::string dump(compilation_unit const& unit, interner const& syms) {
+	auto out = std::ostringstream();
+	auto pos = [](std::optional<range> const& r) {
+		return r ? dump_range(*r) : std::string("none");
+	};
+	auto name = [&](auto const& ident) {
+		out << name_of(ident.value, syms) << ' ' << pos(ident.pos) << '\n';
+	};
+	for (auto* s : unit.decls()) {
+		match(s->node)(
+			[&](stmt::fdecl const& d) { out << "fdecl "; name(d.name()); },
+			[&](stmt::fdef const& d) {
+				out << "fdef "; name(d.name());
+				out << "body " << pos(d.body().start_brace()) << ' '
+					<< pos(d.body().end_brace()) << '\n';
+			}
+		);
+	}
+	return out.str();
+}
+
+static void check(std::string const& what, std::string const& got,
+	std::string const& expected, std::string_view text) {
+	if (got == expected) {
+		return;
+	}
+	++failures;
+	std::cerr << "FAILED: " << what << "\n--- text\n" << text
+		<< "\n--- got\n" << got << "--- expected\n" << expected;
+}
+
+/**
+ * The tokens, the tree and every error of a text, compiled from scratch.
+ */
+struct from_scratch {
+	from_scratch(std::string_view text, interner& syms)
+		: lex(syms) {
+		auto sink = err::scoped_sink(errs);
+		lex.reset(source(text));
+		unit.emplace(lex.tokens());
+	}
+
+	relexer lex;
+	std::optional<compilation_unit> unit;
+	err::sink errs;
+};
+
+/**
+ * Applies a random edit.
+ * @param rnd The random generator.
+ * @param lex The lexer to edit.
+ * @return The change of the tokens.
+ */
+static relex_result random_edit(std::mt19937& rnd, relexer& lex) {
+	auto size = lex.src().size();
+	auto from = u32(rnd() % (size + 1));
+	auto to = std::min(size, from + u32(rnd() % 6));
+	auto text = (rnd() % 3 == 0) ? "" : pieces[rnd() % std::size(pieces)];
+	auto const& toks = lex.tokens();
+	return lex.edit(range(toks.position_of(from), toks.position_of(to)), text);
+}
+
+// The relexed tokens and the reparsed tree after every single edit
+static void test_single_edits() {
+	auto rnd = std::mt19937(1);
+	auto syms = interner();
+	for (u32 doc = 0; doc < 100; ++doc) {
+		auto errs = err::sink();
+		auto sink = err::scoped_sink(errs);
+		auto lex = relexer(syms);
+		lex.reset(source(random_text(rnd, 60)));
+		auto unit = compilation_unit(lex.tokens());
+		for (u32 e = 0; e < 100; ++e) {
+			errs.clear();
+			auto change = random_edit(rnd, lex);
+			unit.edit(lex.tokens(), change);
+			auto full = from_scratch(lex.src().text(), syms);
+			auto text = lex.src().text();
+			check("relexed tokens", dump(lex.tokens(), syms), dump(full.lex.tokens(), syms), text);
+			check("relexed errors", dump(lex.errors()), dump(full.lex.errors()), text);
+			check("reparsed tree", dump(unit, syms), dump(*full.unit, syms), text);
+			check("reparsed errors", dump(errs.errors()), dump(full.errs.errors()), text);
+		}
+	}
+}
+
+// Several edits merged into one change and reparsed at once, like the queued
+// changes of a document
+static void test_merged_edits() {
+	auto rnd = std::mt19937(7);
+	auto syms = interner();
+	for (u32 doc = 0; doc < 40; ++doc) {
+		auto errs = err::sink();
+		auto sink = err::scoped_sink(errs);
+		auto lex = relexer(syms);
+		lex.reset(source(random_text(rnd, doc % 4 == 0 ? 2000 : 80)));
+		auto unit = compilation_unit(lex.tokens());
+		for (u32 round = 0; round < 50; ++round) {
+			auto merged = std::optional<relex_result>();
+			u32 size = 0;
+			for (u32 e = 1 + rnd() % 6; e > 0; --e) {
+				// Every edit reports all the lexical errors of the text
+				errs.clear();
+				auto before = lex.tokens().size();
+				auto change = random_edit(rnd, lex);
+				if (merged) {
+					merged = merge(*merged, change, size);
+				}
+				else {
+					merged = change;
+					size = before;
+				}
+			}
+			unit.edit(lex.tokens(), *merged);
+			auto full = from_scratch(lex.src().text(), syms);
+			auto text = lex.src().text();
+			check("merged tree", dump(unit, syms), dump(*full.unit, syms), text);
+			check("merged errors", dump(errs.errors()), dump(full.errs.errors()), text);
+		}
+	}
+}
+
+// Lexing and parsing the chunks of a text on a thread pool
+static void test_parallel() {
+	auto rnd = std::mt19937(3);
+	auto pool = thread_pool(4);
+	for (u32 doc = 0; doc < 10; ++doc) {
+		auto text = random_text(rnd, 60000);
+		auto src = source(text);
+
+		auto serial_syms = interner();
+		auto serial_errs = err::sink();
+		auto serial_toks = std::vector<token>();
+		auto serial_tree = std::string();
+		{
+			auto sink = err::scoped_sink(serial_errs);
+			serial_toks = lexer::all(src, serial_syms);
+			serial_tree = dump(compilation_unit(serial_toks), serial_syms);
+		}
+
+		auto syms = interner();
+		auto errs = err::sink();
+		auto sink = err::scoped_sink(errs);
+		auto toks = lexer::all(src, syms, pool);
+		check("parallel tokens", dump(toks, syms), dump(serial_toks, serial_syms), "");
+		auto tree = dump(compilation_unit(toks, pool), syms);
+		check("parallel tree", tree, serial_tree, "");
+		check("parallel errors", dump(errs.errors()), dump(serial_errs.errors()), "");
+	}
+}
+
+/**
+ * Copies the bytes of a cache file, like it was mapped.
+ * @param bytes The bytes.
+ * @param size The number of bytes to copy from the front.
+ * @return The 8-byte aligned copy.
+ */
+static std::shared_ptr<void const> file_of(std::vector<u8> const& bytes, std::size_t size) {
+	auto words = std::make_shared<std::vector<u64>>(size / 8 + 1);
+	std::memcpy(words->data(), bytes.data(), size);
+	return std::shared_ptr<void const>(words, words->data());
+}
+
+// Writing a cache file and restoring from it, and rejecting the damaged files
+static void test_cache() {
+	auto rnd = std::mt19937(5);
+	for (u32 doc = 0; doc < 50; ++doc) {
+		auto text = random_text(rnd, doc % 5 == 0 ? 3000 : 100);
+		auto src = source(text);
+		auto syms = interner();
+		auto errs = err::sink();
+		auto bytes = std::vector<u8>();
+		auto expected_toks = std::string();
+		auto expected_lex_errs = std::string();
+		auto expected_tree = std::string();
+		{
+			auto sink = err::scoped_sink(errs);
+			auto toks = token_table::lex(src, syms);
+			auto lex_errs = errs.errors();
+			auto unit = compilation_unit(toks);
+			bytes = serialize(src, toks, lex_errs, unit);
+			expected_toks = dump(toks, syms);
+			expected_lex_errs = dump(lex_errs);
+			expected_tree = dump(unit, syms);
+		}
+		auto hash = content_hash(src.text());
+
+		auto view = cache_view::open(file_of(bytes, bytes.size()), bytes.size(), src, hash);
+		if (!view) {
+			check("cache accepted", "rejected", "accepted", text);
+			continue;
+		}
+		// Restored into a new interner, like in the next session
+		auto restored_syms = interner();
+		auto restored_errs = err::sink();
+		auto sink = err::scoped_sink(restored_errs);
+		auto toks = view->tokens(restored_syms);
+		auto lex_errs = view->lexical_errors(toks);
+		check("cached tokens", dump(toks, restored_syms), expected_toks, text);
+		check("cached lexical errors", dump(lex_errs), expected_lex_errs, text);
+		auto unit = compilation_unit(toks, *view);
+		check("cached tree", dump(unit, restored_syms), expected_tree, text);
+		auto all_errs = lex_errs;
+		all_errs.insert(all_errs.end(), restored_errs.errors().begin(), restored_errs.errors().end());
+		check("cached errors", dump(all_errs), dump(errs.errors()), text);
+
+		auto accepted = [&](std::vector<u8> const& b, std::size_t size, source const& s) {
+			return cache_view::open(file_of(b, size), size, s, content_hash(s.text()))
+				? "accepted" : "rejected";
+		};
+		for (auto size : { bytes.size() - 1, bytes.size() / 2, sizeof(cache_header), std::size_t(7) }) {
+			check("truncated cache", accepted(bytes, size, src), "rejected", text);
+		}
+		for (u32 i = 0; i < 8; ++i) {
+			auto damaged = bytes;
+			damaged[rnd() % damaged.size()] ^= u8(1 + rnd() % 255);
+			check("corrupt cache", accepted(damaged, damaged.size(), src), "rejected", text);
+		}
+		// A different text of the same size, even if the hashes collided
+		auto other_text = text;
+		other_text[rnd() % other_text.size()] ^= 1;
+		auto other = source(other_text);
+		check("cache of another text",
+			cache_view::open(file_of(bytes, bytes.size()), bytes.size(), other, hash) ? "accepted" : "rejected",
+			"rejected", text);
+	}
+}
+
+int main() {
+	err::init();
+	test_single_edits();
+	test_merged_edits();
+	test_parallel();
+	test_cache();
+	if (failures != 0) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,30 @@
+#include "convert.hpp"
+
+lsp::position yk_to_lsp(yk::position const& p) {
+	return lsp::position(p.row(), p.column());
+}
+
+lsp::range yk_to_lsp(yk::range const& r) {
+	return lsp::range(
+		yk_to_lsp(r.start()),
+		yk_to_lsp(r.end())
+	);
+}
+
+yk::position lsp_to_yk(lsp::position const& p) {
+	return yk::position::row_col(p.line(), p.character());
+}
+
+yk::range lsp_to_yk(lsp::range const& r) {
+	return yk::range(
+		lsp_to_yk(r.start()),
+		lsp_to_yk(r.end())
+	);
+}
+
+lsp::diagnostic error_to_diagnostic(yk::err::error_t const& err) {
+	return lsp::diagnostic()
+		.message(yk::err::message(err))
+		.severity(lsp::diagnostic_severity::error)
+		.diagnostic_range(yk_to_lsp(yk::err::error_range(err)));
+}
@@ -0,0 +1,52 @@
+/**
+ * convert.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Conversions between the compiler and the LSP structures.
+ */
+
+#ifndef YK_SERVER_CONVERT_HPP
+#define YK_SERVER_CONVERT_HPP
+
+#include <lsp/common.hpp>
+#include <lsp/lsp.hpp>
+#include <yk/error.hpp>
+#include <yk/lexer.hpp>
+
+/**
+ * Converts a compiler position to an LSP position.
+ * @param p The position to convert.
+ * @return The LSP position.
+ */
+lsp::position yk_to_lsp(yk::position const& p);
+
+/**
+ * Converts a compiler range to an LSP range.
+ * @param r The range to convert.
+ * @return The LSP range.
+ */
+lsp::range yk_to_lsp(yk::range const& r);
+
+/**
+ * Converts an LSP position to a compiler position.
+ * @param p The position to convert.
+ * @return The compiler position.
+ */
+yk::position lsp_to_yk(lsp::position const& p);
+
+/**
+ * Converts an LSP range to a compiler range.
+ * @param r The range to convert.
+ * @return The compiler range.
+ */
+yk::range lsp_to_yk(lsp::range const& r);
+
+/**
+ * Creates the diagnostic message for a compiler error.
+ * @param err The error to convert.
+ * @return The diagnostic, that can be published to the client.
+ */
+lsp::diagnostic error_to_diagnostic(yk::err::error_t const& err);
+
+#endif /* YK_SERVER_CONVERT_HPP */
@@ -1,74 +1,46 @@
+#include <algorithm>
 #include <iostream>
+#include <optional>
+#include <string>
 #include <lsp/common.hpp>
 #include <lsp/lsp.hpp>
+#include <yk/cache.hpp>
+#include <yk/compilation.hpp>
 #include <yk/error.hpp>
 #include <yk/lexer.hpp>
-#include <yk/parser.hpp>
+#include <yk/relexer.hpp>
+#include <yk/source.hpp>
+#include "convert.hpp"
 
-static lsp::position yk_to_lsp(yk::position const& p) {
-	return lsp::position(p.row(), p.column());
-}
-
-static lsp::range yk_to_lsp(yk::range const& r) {
-	return lsp::range(
-		yk_to_lsp(r.start()),
-		yk_to_lsp(r.end())
-	);
-}
-
-static yk::position lsp_to_yk(lsp::position const& p) {
-	return yk::position::row_col(p.line(), p.character());
-}
-
-static yk::range lsp_to_yk(lsp::range const& r) {
-	return yk::range(
-		lsp_to_yk(r.start()),
-		lsp_to_yk(r.end())
-	);
-}
-
-static lsp::diagnostic error_to_diagnostic(yk::err::error_t const& err) {
-	return yk::match(err)(
-		[](yk::err::unclosed_comment const& e) {
-			return lsp::diagnostic()
-				.message(std::string("Unclosed comment with nesting " + std::to_string(e.depth())))
-				.severity(lsp::diagnostic_severity::error)
-				.diagnostic_range(yk_to_lsp(e.err_range()));
-		},
-		[](yk::err::unexpected_char const& e) {
-			return lsp::diagnostic()
-				.message(std::string("Unexpected character '") + e.character() + std::string("' (code: ") + std::to_string(e.character_code()) + ")")
-				.severity(lsp::diagnostic_severity::error)
-				.diagnostic_range(yk_to_lsp(e.err_range()));
-		},
-		[](yk::err::unexpected_token const& e) {
-			auto msg = std::string("Unexpected token!");
-			if (e.expected_instead()) {
-				msg += std::string(" In this context ") + e.expected_instead() + std::string(" is expected!");
-			}
-			return lsp::diagnostic()
-				.message(std::move(msg))
-				.severity(lsp::diagnostic_severity::error)
-				.diagnostic_range(yk_to_lsp(e.err_range()));
-		},
-		[](yk::err::expected_token const& e) {
-			return lsp::diagnostic()
-				.message(std::string("Unexpected token, expected ") + e.expectation() + std::string(" instead!"))
-				.severity(lsp::diagnostic_severity::error)
-				.diagnostic_range(yk_to_lsp(e.err_range()));
-		}
-	);
-}
+// The number of diagnostics published for a document, when the client does
+// not configure it. A broken or binary file can produce errors for most of
+// it's tokens, those would only flood the client.
+static constexpr std::size_t default_max_diagnostics = 1000;
 
 struct my_server : public lsp::langserver {
-	my_server() {
+	my_server()
+		: m_Lexer(m_Symbols), m_MaxDiagnostics(default_max_diagnostics) {
 		yk::err::init();
 	}
 
 	lsp::initialize_result initialize(lsp::initialize_params const& p) override {
+		// The cap can be set with { "maxDiagnostics": n } in the options. The
+		// cache is only used when it's directory is given with
+		// { "cacheDirectory": "path" }, nothing is written without asking
+		auto const& opts = p.initialization_options();
+		if (opts.is_object()) {
+			auto it = opts.find("maxDiagnostics");
+			if (it != opts.end() && it->is_number_unsigned()) {
+				m_MaxDiagnostics = it->get<std::size_t>();
+			}
+			auto dir = opts.find("cacheDirectory");
+			if (dir != opts.end() && dir->is_string()) {
+				m_Cache.emplace(dir->get<std::string>());
+			}
+		}
 		return lsp::initialize_result()
 			.capabilities(lsp::server_capabilities()
-				.text_document_sync(lsp::text_document_sync_kind::full)
+				.text_document_sync(lsp::text_document_sync_kind::incremental)
 				.document_highlight_provider(true)
 				.folding_range_provider(true)
 			);
@@ -76,80 +48,176 @@ struct my_server : public lsp::langserver {
 
 	void on_text_document_opened(lsp::did_open_text_document_params const& p) override {
 		m_URI = p.text_document().uri();
-		recompile(p.text_document().text().c_str());
+		auto sink = yk::err::scoped_sink(m_Errors);
+		yk::err::clear();
+		auto src = yk::source(p.text_document().text());
+		auto cached = m_Cache ? m_Cache->find(src) : std::nullopt;
+		if (cached) {
+			// Unchanged since it was last saved, nothing is lexed or parsed
+			std::cerr << "Restoring from cache..." << std::endl;
+			m_Symbols = yk::interner();
+			auto toks = cached->tokens(m_Symbols);
+			auto lex_errs = cached->lexical_errors(toks);
+			m_Lexer.restore(std::move(src), std::move(toks), std::move(lex_errs));
+			m_Unit.emplace(m_Lexer.tokens(), *cached);
+		}
+		else {
+			relex(std::move(src));
+			recompile();
+			// The client gets the diagnostics before the file is written
+			make_diagnostics();
+			store();
+			return;
+		}
+		make_diagnostics();
 	}
 
 	void on_text_document_changed(lsp::did_change_text_document_params const& p) override {
-		lsp_assert(p.content_changes().size() == 1);
-		auto const& change = p.content_changes().front();
-		lsp_assert(change.full_content());
-		std::string const& src = change.text();
-		recompile(src.c_str());
+		std::cerr << "Starting lexing..." << std::endl;
+		auto sink = yk::err::scoped_sink(m_Errors);
+		// The edits are applied to the tokens one by one, but the changes are
+		// merged, so the document is parsed once, however many edits came in
+		bool full = !m_Unit;
+		std::optional<yk::relex_result> changed;
+		yk::u32 size = 0; // The token count before the merged change
+		for (auto const& change : p.content_changes()) {
+			// Every edit reports all the lexical errors of the document
+			yk::err::clear();
+			if (change.full_content()) {
+				relex(yk::source(change.text()));
+				full = true;
+				continue;
+			}
+			auto before = m_Lexer.tokens().size();
+			auto edit = m_Lexer.edit(lsp_to_yk(*change.change_range()), change.text());
+			if (full) {
+				// Everything is parsed anyway
+				continue;
+			}
+			if (changed) {
+				changed = yk::merge(*changed, edit, size);
+			}
+			else {
+				changed = edit;
+				size = before;
+			}
+		}
+		if (!full && m_Symbols.size() > std::max<std::size_t>(4096, 2 * m_Lexer.tokens().size())) {
+			// Most names were edited away, the document is compiled again with
+			// only the names it still has
+			std::cerr << "Rebuilding " << m_Symbols.size() << " names..." << std::endl;
+			yk::err::clear();
+			relex(yk::source(std::string(m_Lexer.src().text())));
+			full = true;
+		}
+		if (full) {
+			recompile();
+		}
+		else if (changed) {
+			// Only the declarations touching the changed tokens are parsed
+			m_Unit->edit(m_Lexer.tokens(), *changed);
+		}
+		make_diagnostics();
 	}
 
 	void on_text_document_saved(lsp::did_save_text_document_params const& p) override {
 		//std::cerr << "Saved " << p.text_document().uri() << '!' << std::endl;
+		// The saved text is what the next session opens
+		store();
 	}
 
-	std::vector<lsp::document_highlight> on_text_document_highlight(lsp::text_document_position_params const& p) override {
+	std::vector<lsp::document_highlight> on_text_document_highlight(lsp::text_document_position_params const& p,
+		lsp::cancellation_token const&) override {
+		// A single token is found with a binary search, there's nothing to
+		// cancel
 		auto const& doc_pos = p.document_position();
-		auto click_pos = lsp_to_yk(doc_pos);
-		auto clicked_tok = yk::lexer::find_token_at(std::begin(m_Tokens), std::end(m_Tokens), click_pos);
-		if (clicked_tok == std::end(m_Tokens)) {
+		auto const& toks = m_Lexer.tokens();
+		// The position is converted to an offset once, tokens are searched by
+		// their offsets
+		auto click_off = toks.lines().offset_of(lsp_to_yk(doc_pos));
+		auto clicked_tok = toks.find_at(click_off);
+		if (clicked_tok == toks.size()) {
 			std::cerr << "Clicked on emptyness!" << std::endl;
 			return {};
 		}
-		auto const& tok = *clicked_tok;
+		auto tok = toks[clicked_tok];
 		std::cerr << "Clicked on: " << yk::u32(tok.type()) << " - '" << tok.value() << "'" << std::endl;
 		return {
 			lsp::document_highlight().highlight_range(yk_to_lsp(tok.range_()))
 		};
 	}
 
-	std::vector<lsp::folding_range> on_folding_range(lsp::folding_range_params const& p) override {
+	std::vector<lsp::folding_range> on_folding_range(lsp::folding_range_params const& p,
+		lsp::cancellation_token const& cancel) override {
 		std::vector<lsp::folding_range> result;
-		for (auto const& t : m_Tokens) {
-			if (t.type() == yk::token::NestedComment) {
-				result.push_back(lsp::folding_range()
-					.fold_range(yk_to_lsp(t.range_()))
-				);
-			}
-		}
+		auto const& toks = m_Lexer.tokens();
+		toks.for_each_of(yk::token::NestedComment, [&](yk::u32 i) {
+			result.push_back(lsp::folding_range()
+				.fold_range(yk_to_lsp(toks.range_of(i)))
+			);
+			return !cancel.cancelled();
+		});
 		return result;
 	}
 
 	void make_diagnostics() {
-		auto const& errs = yk::err::errors();
+		auto const& errs = m_Errors.errors();
+		// Only the first errors are converted, the rest would be dropped anyway
+		auto count = std::min(errs.size(), m_MaxDiagnostics);
 		std::vector<lsp::diagnostic> diags;
-		for (auto const& err : errs) {
-			diags.push_back(error_to_diagnostic(err));
+		diags.reserve(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			diags.push_back(error_to_diagnostic(errs[i]));
 		}
-		std::cerr << "Publishing " << errs.size() << " diagnostic messages" << std::endl;
+		std::cerr << "Publishing " << count << " of " << errs.size() << " diagnostic messages" << std::endl;
 		publish_diagnostics(m_URI, diags);
 	}
 
-	void recompile(char const* src) {
-		yk::err::clear();
-		std::cerr << "Starting lexing..." << std::endl;
-		m_Tokens = yk::lexer::all(src);
-		std::cerr << "Starting parsing..." << std::endl;
-		/* ast =  */ yk::parser::all(m_Tokens);
-		std::cerr << "Making diagnostics..." << std::endl;
-		make_diagnostics();
-
-		std::cerr << "Tokens: " << std::endl;
-		for (auto const& t : m_Tokens) {
-			std::cerr << "  [" << t.start().row() << " :: " << t.start().column() << " - " << t.end().column() << "] - '" << t.value() << "'" << std::endl;
+	void store() {
+		if (m_Cache && m_Unit
+			&& !m_Cache->store(m_Lexer.src(), m_Lexer.tokens(), m_Lexer.errors(), *m_Unit)) {
+			std::cerr << "Could not write the cache" << std::endl;
 		}
 	}
 
+	// Lexes a text from scratch, with a new interner, so the names of the
+	// previous texts are freed. Every symbol of the old tokens and tree is
+	// invalid after this, the tree has to be recompiled
+	void relex(yk::source&& src) {
+		m_Symbols = yk::interner();
+		m_Lexer.reset(std::move(src));
+	}
+
+	// Expects the lexer to be up to date, with the lexical errors reported
+	void recompile() {
+		std::cerr << "Starting parsing..." << std::endl;
+		// The previous AST is freed in one go before parsing the new one
+		m_Unit.emplace(m_Lexer.tokens());
+		std::cerr << "Tokens: " << m_Lexer.tokens().size() << std::endl;
+	}
+
 private:
-	std::vector<yk::token> m_Tokens;
+	// Names are interned until the document is lexed from scratch, so symbols
+	// stay comparable between incremental compilations. Edits leave the names
+	// they removed behind, so it's rebuilt once it has twice as many names as
+	// the document has tokens
+	yk::interner m_Symbols;
+	// Keeps the source and the tokens up to date with the edits
+	yk::relexer m_Lexer;
+	// The AST of the last compilation
+	std::optional<yk::compilation_unit> m_Unit;
+	// The parse results of the saved documents, if the client asked for it
+	std::optional<yk::parse_cache> m_Cache;
+	// The errors of the document, installed while it's compiled
+	yk::err::sink m_Errors;
+	// At most this many errors are published for the document
+	std::size_t m_MaxDiagnostics;
 	std::string m_URI;
 };
 
 int main() {
 	auto srvr = my_server();
-	lsp::start_langserver(srvr, std::cin, std::cout);
+	// Talk through the standard descriptors directly, skipping the streams
+	lsp::start_langserver(srvr, 0, 1);
 	return 0;
 }
@@ -0,0 +1,32 @@
+#include "cancel.hpp"
+
+namespace lsp {
+
+void cancellation_registry::add(json const& id) {
+	auto lock = std::lock_guard<std::mutex>(m_Mutex);
+	m_Flags[id] = std::make_shared<std::atomic<bool>>(false);
+}
+
+cancellation_token cancellation_registry::find(json const& id) {
+	auto lock = std::lock_guard<std::mutex>(m_Mutex);
+	auto it = m_Flags.find(id);
+	if (it == m_Flags.end()) {
+		return cancellation_token();
+	}
+	return cancellation_token(it->second);
+}
+
+void cancellation_registry::cancel(json const& id) {
+	auto lock = std::lock_guard<std::mutex>(m_Mutex);
+	auto it = m_Flags.find(id);
+	if (it != m_Flags.end()) {
+		it->second->store(true, std::memory_order_relaxed);
+	}
+}
+
+void cancellation_registry::remove(json const& id) {
+	auto lock = std::lock_guard<std::mutex>(m_Mutex);
+	m_Flags.erase(id);
+}
+
+} /* namespace lsp */
@@ -0,0 +1,90 @@
+/**
+ * cancel.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Cooperative cancellation of the requests, as the client asks
+ * for it with $/cancelRequest.
+ */
+
+#ifndef LSP_CANCEL_HPP
+#define LSP_CANCEL_HPP
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "common.hpp"
+
+namespace lsp {
+
+/**
+ * Tells a request handler that the client doesn't need the result anymore.
+ * Long-running handlers should poll it and return early when it's set,
+ * whatever they return then is discarded.
+ */
+struct cancellation_token {
+	/**
+	 * Creates a token that's never cancelled.
+	 */
+	cancellation_token() = default;
+
+	/**
+	 * Checks, if the request has been cancelled. Cheap enough to be called in
+	 * a tight loop.
+	 * @return True, if the handler should stop.
+	 */
+	bool cancelled() const {
+		return m_Flag && m_Flag->load(std::memory_order_relaxed);
+	}
+
+private:
+	friend struct cancellation_registry;
+
+	explicit cancellation_token(std::shared_ptr<std::atomic<bool>> flag)
+		: m_Flag(std::move(flag)) {
+	}
+
+	std::shared_ptr<std::atomic<bool>> m_Flag;
+};
+
+/**
+ * The tokens of the requests in flight, keyed by the request IDs. Requests
+ * are registered as soon as they are read, so a cancellation that arrives
+ * while the request is still queued stops it before it even starts. Every
+ * operation is thread-safe.
+ */
+struct cancellation_registry {
+	/**
+	 * Registers a request.
+	 * @param id The ID of the request.
+	 */
+	void add(json const& id);
+
+	/**
+	 * Returns the token of a request.
+	 * @param id The ID of the request.
+	 * @return The token, or one that's never cancelled for an unknown ID.
+	 */
+	cancellation_token find(json const& id);
+
+	/**
+	 * Cancels a request. Requests that are already done are ignored.
+	 * @param id The ID of the request.
+	 */
+	void cancel(json const& id);
+
+	/**
+	 * Forgets a request, after it has been replied to.
+	 * @param id The ID of the request.
+	 */
+	void remove(json const& id);
+
+private:
+	std::mutex m_Mutex;
+	std::map<json, std::shared_ptr<std::atomic<bool>>> m_Flags;
+};
+
+} /* namespace lsp */
+
+#endif /* LSP_CANCEL_HPP */
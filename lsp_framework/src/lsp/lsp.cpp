@@ -1,6 +1,11 @@
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include "jwrap.hpp"
 #include "lsp.hpp"
+#include "queue.hpp"
 
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -25,20 +30,133 @@ void langserver::send_notification(char const* method, json&& p) {
 }
 
 void langserver::publish_diagnostics(std::string const& uri, std::vector<diagnostic> const& diags) {
-	send_notification(
+	m_Connection->notify(
 		"textDocument/publishDiagnostics",
 		publish_diagnostics_params()
 			.uri(uri)
 			.diagnostics(diags)
-			.to_json()
 	);
 }
 
+/**
+ * The threads and queues of a connection that works with descriptors. An
+ * empty element in a queue marks the end of the messages.
+ *
+ * The reader never waits for the handler. When the inbox is full, the
+ * messages wait in an overflow list instead, so the reader goes on reading
+ * and a $/cancelRequest behind them still takes effect right away. The
+ * handler moves them back to the inbox as it makes room.
+ */
+struct connection::io_threads {
+	using incoming = std::optional<rpc::message>;
+
+	// The messages usually fit in the lock-free inbox
+	static constexpr std::size_t inbox_capacity = 64;
+	// Anyone can write, so the outgoing messages need a multi-producer queue
+	static constexpr std::size_t outbox_capacity = 256;
+
+	/**
+	 * Hands a message to the handler without waiting. Only called by the
+	 * reader.
+	 * @param msg The message, or nullopt at the end of the input.
+	 */
+	void deliver(incoming&& msg) {
+		if (!spilled.load(std::memory_order_acquire) && inbox.try_push(std::move(msg))) {
+			return;
+		}
+		auto guard = std::lock_guard<std::mutex>(overflow_lock);
+		// The handler might have emptied the overflow since
+		if (overflow.empty() && inbox.try_push(std::move(msg))) {
+			return;
+		}
+		overflow.push_back(std::move(msg));
+		spilled.store(true, std::memory_order_release);
+	}
+
+	/**
+	 * Moves the overflowing messages to the inbox, as many as fit. Only
+	 * called by the handler, after taking a message. Either the overflow
+	 * ends up empty or the inbox full, so the handler never waits on an
+	 * empty inbox while there are messages in the overflow.
+	 */
+	void refill() {
+		if (!spilled.load(std::memory_order_acquire)) {
+			return;
+		}
+		auto guard = std::lock_guard<std::mutex>(overflow_lock);
+		while (!overflow.empty() && inbox.try_push(std::move(overflow.front()))) {
+			overflow.pop_front();
+		}
+		spilled.store(!overflow.empty(), std::memory_order_release);
+	}
+
+	spsc_channel<incoming> inbox{ inbox_capacity };
+	mpsc_channel<outgoing> outbox{ outbox_capacity };
+	std::mutex overflow_lock;
+	std::deque<incoming> overflow;
+	std::atomic<bool> spilled{ false }; // True, if the overflow is not empty
+	std::thread reader;
+	std::thread writer;
+};
+
+connection::connection(std::istream& in, std::ostream& out)
+	: m_In(&in), m_Out(&out) {
+	global_init();
+}
+
+connection::connection(int fd, std::ostream& out)
+	: m_In(nullptr), m_Out(&out),
+	m_Reader(std::make_unique<message_reader>(fd)) {
+	global_init();
+}
+
+connection::connection(int in_fd, int out_fd)
+	: m_In(nullptr), m_Out(nullptr),
+	m_Reader(std::make_unique<message_reader>(in_fd)),
+	m_Writer(std::make_unique<message_writer>(out_fd)),
+	m_Threads(std::make_unique<io_threads>()) {
+	global_init();
+	m_Threads->reader = std::thread([this] {
+		while (auto body = m_Reader->next()) {
+			auto msg = rpc::message::parse(*body);
+			// Cancellations take effect here, not behind the queued messages
+			if (track(msg)) {
+				m_Threads->deliver(std::move(msg));
+			}
+		}
+		m_Threads->deliver(std::nullopt);
+	});
+	m_Threads->writer = std::thread([this] {
+		while (auto body = m_Threads->outbox.pop()) {
+			m_Writer->send(body);
+		}
+	});
+}
+
+connection::~connection() {
+	if (m_Threads) {
+		m_Threads->outbox.push(outgoing());
+		m_Threads->writer.join();
+		// The client might not have closed the input, don't wait for it
+		m_Reader->interrupt();
+		m_Threads->reader.join();
+	}
+}
+
 void connection::global_init() {
 	platform_init();
 }
 
+void connection::post(outgoing&& body) {
+	lsp_assert(m_Threads);
+	m_Threads->outbox.push(std::move(body));
+}
+
 void connection::write(rpc::message const& msg) {
+	if (m_Threads) {
+		post([msg = msg](json_writer& w) { write_message(w, msg); });
+		return;
+	}
 	auto content = msg.to_json().dump();
 	out()
 		<< "Content-Length: "
@@ -86,7 +204,61 @@ connection::message_header connection::read_message_header() {
 	return h;
 }
 
-rpc::message connection::read() {
+std::optional<rpc::message> connection::read() {
+	if (m_Threads) {
+		auto msg = m_Threads->inbox.pop();
+		m_Threads->refill();
+		return msg;
+	}
+	while (true) {
+		auto msg = read_message();
+		if (!msg || track(*msg)) {
+			return msg;
+		}
+	}
+}
+
+template <typename Pred>
+std::optional<rpc::message> connection::read_queued_if(Pred&& pred) {
+	if (!m_Threads) {
+		return std::nullopt;
+	}
+	auto msg = m_Threads->inbox.try_pop_if([&](std::optional<rpc::message> const& m) {
+		return m && pred(*m);
+	});
+	if (!msg) {
+		return std::nullopt;
+	}
+	m_Threads->refill();
+	return std::move(*msg);
+}
+
+bool connection::track(rpc::message const& msg) {
+	if (msg.is_request()) {
+		m_Cancellations.add(msg.as_request().id());
+		return true;
+	}
+	if (msg.is_notification() && msg.as_notification().method() == "$/cancelRequest") {
+		auto const& params = msg.as_notification().params();
+		if (auto it = params.find("id"); it != params.end()) {
+			m_Cancellations.cancel(*it);
+		}
+		return false;
+	}
+	return true;
+}
+
+std::optional<rpc::message> connection::read_message() {
+	if (m_Reader) {
+		auto body = m_Reader->next();
+		if (!body) {
+			return std::nullopt;
+		}
+		return rpc::message::parse(*body);
+	}
+	if (in().peek() == std::istream::traits_type::eof()) {
+		return std::nullopt;
+	}
 	auto h = read_message_header();
 	lsp_assert(h.content_length > 0);
 	auto content = std::make_unique<char[]>(h.content_length + 1);
@@ -98,15 +270,89 @@ rpc::message connection::read() {
 template <typename V>
 json vector_to_json(V&& vec);
 
-void langserver_handler::next() {
+template <typename T>
+void connection::reply_list(rpc::request const& req, std::vector<T> results) {
+	if (!m_Writer) {
+		write(req.reply(vector_to_json(results)));
+		return;
+	}
+	// The results are moved along, the writer thread might serialize them
+	post([id = req.id(), results = std::move(results)](json_writer& w) {
+		w.begin_object()
+			.member("jsonrpc", "2.0")
+			.member("id", id)
+			.key("result")
+			.begin_array();
+		for (auto const& res : results) {
+			res.write_json(w);
+		}
+		w.end_array().end_object();
+	});
+}
+
+template <typename T>
+void connection::notify(char const* method, T params) {
+	if (!m_Writer) {
+		write(rpc::notification(method, params.to_json()));
+		return;
+	}
+	post([method, params = std::move(params)](json_writer& w) {
+		w.begin_object()
+			.member("jsonrpc", "2.0")
+			.member("method", method)
+			.key("params");
+		params.write_json(w);
+		w.end_object();
+	});
+}
+
+/**
+ * Creates the reply to a request that the client has cancelled.
+ * @param req The cancelled request.
+ * @return The error response.
+ */
+static rpc::response cancelled_reply(rpc::request const& req) {
+	return req.reply(json(nullptr), rpc::response_error<json>(
+		rpc::error_code::request_cancelled, "Request cancelled"));
+}
+
+/**
+ * Checks, if a message is a change of a given document.
+ * @param msg The message to check.
+ * @param uri The URI of the document.
+ * @return True, if the message is a didChange of the document.
+ */
+static bool is_change_of(rpc::message const& msg, std::string const& uri) {
+	if (!msg.is_notification() || msg.as_notification().method() != "textDocument/didChange") {
+		return false;
+	}
+	auto const& params = msg.as_notification().params();
+	auto doc = params.find("textDocument");
+	if (doc == params.end()) {
+		return false;
+	}
+	auto it = doc->find("uri");
+	return it != doc->end() && *it == uri;
+}
+
+bool langserver_handler::next() {
 	// XXX(LPeter1997): Factor out patterns like request -> make reply -> fill -> to json -> write
 	// XXX(LPeter1997): assert lsp_assert(m_Initialized); everywhere where required
 
-	auto msg = m_Connection.read();
+	auto next_msg = m_Connection.read();
+	if (!next_msg) {
+		return false;
+	}
+	auto& msg = *next_msg;
 	if (msg.is_request()) {
 		auto const& req = msg.as_request();
+		auto token = m_Connection.cancellations().find(req.id());
 
-		if (req.method() == "initialize") {
+		if (token.cancelled()) {
+			// Cancelled while it was waiting in the queue, don't even start it
+			m_Connection.write(cancelled_reply(req));
+		}
+		else if (req.method() == "initialize") {
 			// XXX(LPeter1997): For notifications and requests there are special replies when uninitialized
 			if (m_Initialized) {
 				// XXX(LPeter1997): Send error
@@ -122,15 +368,23 @@ void langserver_handler::next() {
 		}
 		else if (req.method() == "textDocument/documentHighlight") {
 			auto params = text_document_position_params::from_json(req.params());
-			auto res_list = m_Langserver->on_text_document_highlight(params);
-			auto response = req.reply(vector_to_json(res_list));
-			m_Connection.write(response);
+			auto res_list = m_Langserver->on_text_document_highlight(params, token);
+			if (token.cancelled()) {
+				m_Connection.write(cancelled_reply(req));
+			}
+			else {
+				m_Connection.reply_list(req, std::move(res_list));
+			}
 		}
 		else if (req.method() == "textDocument/foldingRange") {
 			auto params = folding_range_params::from_json(req.params());
-			auto fold_list = m_Langserver->on_folding_range(params);
-			auto response = req.reply(vector_to_json(fold_list));
-			m_Connection.write(response);
+			auto fold_list = m_Langserver->on_folding_range(params, token);
+			if (token.cancelled()) {
+				m_Connection.write(cancelled_reply(req));
+			}
+			else {
+				m_Connection.reply_list(req, std::move(fold_list));
+			}
 		}
 		else {
 			std::cerr
@@ -140,6 +394,7 @@ void langserver_handler::next() {
 				<< std::endl;
 			lsp_unimplemented;
 		}
+		m_Connection.cancellations().remove(req.id());
 	}
 	else if (msg.is_notification()) {
 		auto const& noti = msg.as_notification();
@@ -159,6 +414,19 @@ void langserver_handler::next() {
 		}
 		else if (noti.method() == "textDocument/didChange") {
 			auto param = did_change_text_document_params::from_json(noti.params());
+			// The changes of the document that are already waiting are applied
+			// in one go, so only the newest version is analyzed
+			auto uri = param.text_document().uri();
+			while (auto queued = m_Connection.read_queued_if([&](rpc::message const& m) {
+				return is_change_of(m, uri);
+			})) {
+				auto more = did_change_text_document_params::from_json(queued->as_notification().params());
+				auto& changes = param.content_changes();
+				changes.insert(changes.end(),
+					std::make_move_iterator(more.content_changes().begin()),
+					std::make_move_iterator(more.content_changes().end()));
+				param.text_document(std::move(more.text_document()));
+			}
 			m_Langserver->on_text_document_changed(param);
 		}
 		else {
@@ -179,13 +447,22 @@ void langserver_handler::next() {
 			<< std::endl;
 		lsp_unimplemented;
 	}
+	return true;
 }
 
 void start_langserver(langserver& ls, std::istream& in, std::ostream& out) {
 	auto h = langserver_handler(in, out, ls);
-	while (true) {
-		h.next();
-	}
+	while (h.next());
+}
+
+void start_langserver(langserver& ls, int fd, std::ostream& out) {
+	auto h = langserver_handler(fd, out, ls);
+	while (h.next());
+}
+
+void start_langserver(langserver& ls, int in_fd, int out_fd) {
+	auto h = langserver_handler(in_fd, out_fd, ls);
+	while (h.next());
 }
 
 template <typename T>
@@ -1047,6 +1324,14 @@ json range::to_json() const {
 		.get();
 }
 
+void range::write_json(json_writer& w) const {
+	w.begin_object().key("start");
+	start().write_json(w);
+	w.key("end");
+	end().write_json(w);
+	w.end_object();
+}
+
 // Position
 
 position::position(i32 ln, i32 ch)
@@ -1068,6 +1353,13 @@ json position::to_json() const {
 		.get();
 }
 
+void position::write_json(json_writer& w) const {
+	w.begin_object()
+		.member("line", line())
+		.member("character", character())
+		.end_object();
+}
+
 // TextDocumentPositionParams
 
 text_document_position_params text_document_position_params::from_json(json const& js) {
@@ -1087,6 +1379,13 @@ json document_highlight::to_json() const {
 		.get();
 }
 
+void document_highlight::write_json(json_writer& w) const {
+	w.begin_object().key("range");
+	highlight_range().write_json(w);
+	w.member("kind", i32(kind()))
+		.end_object();
+}
+
 // DidSaveTextDocumentParams
 
 did_save_text_document_params did_save_text_document_params::from_json(json const& js) {
@@ -1136,6 +1435,16 @@ json folding_range::to_json() const {
 		.get();
 }
 
+void folding_range::write_json(json_writer& w) const {
+	w.begin_object()
+		.member("startLine", start_line())
+		.opt_member("startCharacter", start_character())
+		.member("endLine", end_line())
+		.opt_member("endCharacter", end_character())
+		.opt_member("kind", kind() | folding_range_kind_to_json)
+		.end_object();
+}
+
 // Diagnostic
 
 json diagnostic::to_json() const {
@@ -1149,6 +1458,26 @@ json diagnostic::to_json() const {
 		.get();
 }
 
+void diagnostic::write_json(json_writer& w) const {
+	w.begin_object().key("range");
+	diagnostic_range().write_json(w);
+	if (auto const& sev = severity()) {
+		w.member("severity", i32(*sev));
+	}
+	if (auto const& c = code()) {
+		w.key("code");
+		std::visit([&](auto const& val) { w.value(val); }, *c);
+	}
+	w.opt_member("source", source())
+		.member("message", message())
+		.key("relatedInformation")
+		.begin_array();
+	for (auto const& info : related_information()) {
+		info.write_json(w);
+	}
+	w.end_array().end_object();
+}
+
 // DiagnosticRelatedInformation
 
 json diagnostic_related_information::to_json() const {
@@ -1158,6 +1487,13 @@ json diagnostic_related_information::to_json() const {
 		.get();
 }
 
+void diagnostic_related_information::write_json(json_writer& w) const {
+	w.begin_object().key("location");
+	info_location().write_json(w);
+	w.member("message", message())
+		.end_object();
+}
+
 // Location
 
 json location::to_json() const {
@@ -1167,6 +1503,14 @@ json location::to_json() const {
 		.get();
 }
 
+void location::write_json(json_writer& w) const {
+	w.begin_object()
+		.member("uri", uri())
+		.key("range");
+	location_range().write_json(w);
+	w.end_object();
+}
+
 // PublishDiagnosticsParams
 
 json publish_diagnostics_params::to_json() const {
@@ -1176,4 +1520,15 @@ json publish_diagnostics_params::to_json() const {
 		.get();
 }
 
+void publish_diagnostics_params::write_json(json_writer& w) const {
+	w.begin_object()
+		.member("uri", uri())
+		.key("diagnostics")
+		.begin_array();
+	for (auto const& diag : diagnostics()) {
+		diag.write_json(w);
+	}
+	w.end_array().end_object();
+}
+
 } /* namespace lsp */
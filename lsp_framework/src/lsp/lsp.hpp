@@ -11,7 +11,10 @@
 #define LSP_HPP
 
 #include <iostream>
+#include <memory>
+#include "cancel.hpp"
 #include "rpc.hpp"
+#include "transport.hpp"
 
 namespace lsp {
 
@@ -38,8 +41,8 @@ struct langserver {
 	virtual void on_text_document_opened(did_open_text_document_params const&) = 0;
 	virtual void on_text_document_changed(did_change_text_document_params const&) = 0;
 	virtual void on_text_document_saved(did_save_text_document_params const&) = 0;
-	virtual std::vector<document_highlight> on_text_document_highlight(text_document_position_params const&) = 0;
-	virtual std::vector<folding_range> on_folding_range(folding_range_params const&) = 0;
+	virtual std::vector<document_highlight> on_text_document_highlight(text_document_position_params const&, cancellation_token const&) = 0;
+	virtual std::vector<folding_range> on_folding_range(folding_range_params const&, cancellation_token const&) = 0;
 
 	void publish_diagnostics(std::string const& uri, std::vector<diagnostic> const& diags);
 
@@ -55,13 +58,81 @@ private:
  * A helper object to send and receive LSP messages.
  */
 struct connection {
-	explicit connection(std::istream& in, std::ostream& out)
-		: m_In(&in), m_Out(&out) {
-		global_init();
-	}
+	explicit connection(std::istream& in, std::ostream& out);
+
+	/**
+	 * Creates a connection that reads the messages from a file descriptor,
+	 * skipping the stream library.
+	 * @param fd The file descriptor to read from.
+	 * @param out The output stream to write the messages to.
+	 */
+	explicit connection(int fd, std::ostream& out);
+
+	/**
+	 * Creates a connection that reads and writes the messages through file
+	 * descriptors, each on it's own thread. The reader thread frames and
+	 * parses the incoming messages ahead of the handler, and the writer
+	 * thread serializes and sends the outgoing ones, so a slow client or a
+	 * large response doesn't hold up the next message. Writing is
+	 * thread-safe on such a connection.
+	 * @param in_fd The file descriptor to read from.
+	 * @param out_fd The file descriptor to write to.
+	 */
+	explicit connection(int in_fd, int out_fd);
+
+	connection(connection const&) = delete;
+	connection& operator=(connection const&) = delete;
+
+	/**
+	 * Sends the queued messages and stops the I/O threads, if there are any.
+	 * The reader is interrupted, the input doesn't have to end first.
+	 */
+	~connection();
 
 	void write(rpc::message const& msg);
-	rpc::message read();
+
+	/**
+	 * Replies to a request with a list of results. With a descriptor output
+	 * the results are serialized right into the output buffer.
+	 * @param req The request to reply to.
+	 * @param results The results.
+	 */
+	template <typename T>
+	void reply_list(rpc::request const& req, std::vector<T> results);
+
+	/**
+	 * Sends a notification. With a descriptor output the parameters are
+	 * serialized right into the output buffer.
+	 * @param method The method of the notification, that has to outlive the
+	 * connection (like a string literal).
+	 * @param params The parameters.
+	 */
+	template <typename T>
+	void notify(char const* method, T params);
+
+	/**
+	 * Reads the next message.
+	 * @return The message, or nullopt at the end of the input.
+	 */
+	std::optional<rpc::message> read();
+
+	/**
+	 * Takes the next message, if it has already been read ahead and satisfies
+	 * a condition. Never waits for the input, and only finds something on a
+	 * connection with a reader thread.
+	 * @param pred The condition on the message.
+	 * @return The message, or nullopt if there's no such message.
+	 */
+	template <typename Pred>
+	std::optional<rpc::message> read_queued_if(Pred&& pred);
+
+	/**
+	 * Returns the requests in flight. The requests are registered as they are
+	 * read, and $/cancelRequest is handled right there, so it's never
+	 * returned by read().
+	 * @return The registry of the cancellation tokens.
+	 */
+	auto& cancellations() { return m_Cancellations; }
 
 	auto& in() { return *m_In; }
 	auto const& in() const { return *m_In; }
@@ -75,13 +146,41 @@ private:
 		std::string content_type = "";
 	};
 
+	// Writes the body of a message, when writing to a descriptor
+	using outgoing = std::function<void(json_writer&)>;
+
+	struct io_threads;
+
 	static void global_init();
 
+	/**
+	 * Queues a message for the writer thread.
+	 * @param body The function writing the body of the message.
+	 */
+	void post(outgoing&& body);
+
+	/**
+	 * Keeps track of the requests coming in and the cancellations of them.
+	 * @param msg The message that was read.
+	 * @return False, if the message was consumed here.
+	 */
+	bool track(rpc::message const& msg);
+
+	/**
+	 * Reads the next message from the input, without tracking it.
+	 * @return The message, or nullopt at the end of the input.
+	 */
+	std::optional<rpc::message> read_message();
+
 	bool read_message_header_part(message_header& h);
 	message_header read_message_header();
 
 	std::istream* m_In;
 	std::ostream* m_Out;
+	std::unique_ptr<message_reader> m_Reader; // Only when reading a descriptor
+	std::unique_ptr<message_writer> m_Writer; // Only when writing a descriptor
+	cancellation_registry m_Cancellations;
+	std::unique_ptr<io_threads> m_Threads;
 };
 
 /**
@@ -94,13 +193,27 @@ struct langserver_handler {
 		m_Langserver->m_Connection = &m_Connection;
 	}
 
+	explicit langserver_handler(int fd, std::ostream& out, langserver& ls)
+		: m_Connection(fd, out), m_Langserver(&ls) {
+		m_Langserver->m_Connection = &m_Connection;
+	}
+
+	explicit langserver_handler(int in_fd, int out_fd, langserver& ls)
+		: m_Connection(in_fd, out_fd), m_Langserver(&ls) {
+		m_Langserver->m_Connection = &m_Connection;
+	}
+
 	auto& in() { return m_Connection.in(); }
 	auto const& in() const { return m_Connection.in(); }
 
 	auto& out() { return m_Connection.out(); }
 	auto const& out() const { return m_Connection.out(); }
 
-	void next();
+	/**
+	 * Handles the next message.
+	 * @return False, if the input has ended.
+	 */
+	bool next();
 
 private:
 	connection m_Connection;
@@ -109,13 +222,31 @@ private:
 };
 
 /**
- * Starts a language server with an infinite message-loop.
+ * Starts a language server with a message-loop that runs until the input ends.
  * @param ls The language server object to use.
  * @param in The input stream to read the messages from.
  * @param out The output stream to write the messages to.
  */
 void start_langserver(langserver& ls, std::istream& in, std::ostream& out);
 
+/**
+ * Starts a language server that reads the messages right from a file
+ * descriptor, with a single read call for most messages.
+ * @param ls The language server object to use.
+ * @param fd The file descriptor to read the messages from.
+ * @param out The output stream to write the messages to.
+ */
+void start_langserver(langserver& ls, int fd, std::ostream& out);
+
+/**
+ * Starts a language server that reads and writes the messages through file
+ * descriptors. The responses are serialized without building JSON objects.
+ * @param ls The language server object to use.
+ * @param in_fd The file descriptor to read the messages from.
+ * @param out_fd The file descriptor to write the messages to.
+ */
+void start_langserver(langserver& ls, int in_fd, int out_fd);
+
 #define ctors(x) 					\
 x() = default;						\
 x(x const&) = default; 				\
@@ -1024,6 +1155,7 @@ struct position {
 	static position from_json(json const& js);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	named_mem(i32, line);
 	named_mem(i32, character);
@@ -1040,6 +1172,7 @@ struct range {
 	static range from_json(json const& js);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	named_mem(position, start);
 	named_mem(position, end);
@@ -1091,6 +1224,7 @@ struct document_highlight {
 	ctors(document_highlight);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	named_mem(range, highlight_range);
 	named_mem(document_highlight_kind, kind) = document_highlight_kind::text;
@@ -1126,6 +1260,7 @@ struct folding_range {
 	ctors(folding_range);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	folding_range& start(position const& pos);
 	folding_range& end(position const& pos);
@@ -1146,6 +1281,7 @@ struct location {
 	ctors(location);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	named_mem(std::string, uri);
 	named_mem(range, location_range);
@@ -1158,6 +1294,7 @@ struct diagnostic_related_information {
 	ctors(diagnostic_related_information);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	named_mem(location, info_location);
 	named_mem(std::string, message);
@@ -1172,6 +1309,7 @@ struct diagnostic {
 	ctors(diagnostic);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	named_mem(range, diagnostic_range);
 	named_mem(std::optional<diagnostic_severity>, severity) = std::nullopt;
@@ -1188,6 +1326,7 @@ struct publish_diagnostics_params {
 	ctors(publish_diagnostics_params);
 
 	json to_json() const;
+	void write_json(json_writer& w) const;
 
 	named_mem(std::string, uri);
 	named_mem(std::vector<diagnostic>, diagnostics);
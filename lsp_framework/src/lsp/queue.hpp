@@ -0,0 +1,320 @@
+/**
+ * queue.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Bounded lock-free queues that connect the I/O threads of the
+ * language server.
+ */
+
+#ifndef LSP_QUEUE_HPP
+#define LSP_QUEUE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include "common.hpp"
+
+namespace lsp {
+
+// The indices of the two sides are kept on separate cache lines, so a
+// producer and a consumer don't invalidate each other's line on every access
+inline constexpr std::size_t cache_line = 64;
+
+/**
+ * Rounds up to the next power of two.
+ * @param n The number to round.
+ * @return The smallest power of two not less than n.
+ */
+inline std::size_t round_up_pow2(std::size_t n) {
+	std::size_t res = 1;
+	while (res < n) {
+		res <<= 1;
+	}
+	return res;
+}
+
+/**
+ * A bounded single-producer, single-consumer queue.
+ */
+template <typename T>
+struct spsc_queue {
+	using value_type = T;
+
+	explicit spsc_queue(std::size_t capacity)
+		: m_Slots(std::make_unique<T[]>(round_up_pow2(capacity))),
+		m_Mask(round_up_pow2(capacity) - 1), m_Head(0), m_Tail(0) {
+	}
+
+	spsc_queue(spsc_queue const&) = delete;
+	spsc_queue& operator=(spsc_queue const&) = delete;
+
+	/**
+	 * Enqueues an element. Only called by the producer.
+	 * @param val The element, only moved from on success.
+	 * @return False, if the queue is full.
+	 */
+	bool try_push(T&& val) {
+		auto tail = m_Tail.load(std::memory_order_relaxed);
+		if (tail - m_Head.load(std::memory_order_acquire) > m_Mask) {
+			return false;
+		}
+		m_Slots[tail & m_Mask] = std::move(val);
+		m_Tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Returns the next element without dequeuing it. Only called by the
+	 * consumer.
+	 * @return The pointer to the element, or nullptr if the queue is empty.
+	 */
+	T* peek() {
+		auto head = m_Head.load(std::memory_order_relaxed);
+		if (head == m_Tail.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return &m_Slots[head & m_Mask];
+	}
+
+	/**
+	 * Dequeues an element. Only called by the consumer.
+	 * @param out The element is moved here on success.
+	 * @return False, if the queue is empty.
+	 */
+	bool try_pop(T& out) {
+		auto head = m_Head.load(std::memory_order_relaxed);
+		if (head == m_Tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		auto& slot = m_Slots[head & m_Mask];
+		out = std::move(slot);
+		// Don't keep the resources of the element alive in the slot
+		slot = T();
+		m_Head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::unique_ptr<T[]> m_Slots;
+	std::size_t m_Mask;
+	alignas(cache_line) std::atomic<std::size_t> m_Head; // The next to pop
+	alignas(cache_line) std::atomic<std::size_t> m_Tail; // The next to push
+};
+
+/**
+ * A bounded multi-producer, single-consumer queue. Every slot has a sequence
+ * number that tells the producers and the consumer whose turn it is, so the
+ * producers only contend on the tail index.
+ */
+template <typename T>
+struct mpsc_queue {
+	using value_type = T;
+
+	explicit mpsc_queue(std::size_t capacity)
+		: m_Cells(std::make_unique<cell[]>(round_up_pow2(capacity))),
+		m_Mask(round_up_pow2(capacity) - 1), m_Head(0), m_Tail(0) {
+		for (std::size_t i = 0; i <= m_Mask; ++i) {
+			m_Cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	mpsc_queue(mpsc_queue const&) = delete;
+	mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+	/**
+	 * Enqueues an element. Can be called by any thread.
+	 * @param val The element, only moved from on success.
+	 * @return False, if the queue is full.
+	 */
+	bool try_push(T&& val) {
+		auto pos = m_Tail.load(std::memory_order_relaxed);
+		cell* c;
+		while (true) {
+			c = &m_Cells[pos & m_Mask];
+			auto seq = c->seq.load(std::memory_order_acquire);
+			auto diff = std::ptrdiff_t(seq) - std::ptrdiff_t(pos);
+			if (diff == 0) {
+				// The cell is free for this position, try to claim it
+				if (m_Tail.compare_exchange_weak(pos, pos + 1,
+					std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				// The consumer hasn't freed the cell yet, we are full
+				return false;
+			}
+			else {
+				// Another producer took this position
+				pos = m_Tail.load(std::memory_order_relaxed);
+			}
+		}
+		c->value = std::move(val);
+		c->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Dequeues an element. Only called by the consumer.
+	 * @param out The element is moved here on success.
+	 * @return False, if the queue is empty.
+	 */
+	bool try_pop(T& out) {
+		auto& c = m_Cells[m_Head & m_Mask];
+		if (c.seq.load(std::memory_order_acquire) != m_Head + 1) {
+			return false;
+		}
+		out = std::move(c.value);
+		c.value = T();
+		// Hand the cell to the producer of the next round
+		c.seq.store(m_Head + m_Mask + 1, std::memory_order_release);
+		++m_Head;
+		return true;
+	}
+
+private:
+	struct cell {
+		std::atomic<std::size_t> seq;
+		T value;
+	};
+
+	std::unique_ptr<cell[]> m_Cells;
+	std::size_t m_Mask;
+	alignas(cache_line) std::size_t m_Head; // Only touched by the consumer
+	alignas(cache_line) std::atomic<std::size_t> m_Tail;
+};
+
+/**
+ * Lets threads sleep until a condition might have changed. Notifying is a
+ * single atomic load while nobody sleeps, so the queues stay lock-free as long
+ * as they are neither empty nor full.
+ */
+struct parker {
+	/**
+	 * Waits until a condition holds. The condition is checked with the lock
+	 * held once the thread is about to sleep.
+	 * @param ready The condition, that can have side-effects on success.
+	 */
+	template <typename Pred>
+	void wait(Pred&& ready) {
+		// The other side is usually quick, try a few times before sleeping
+		for (int i = 0; i < 64; ++i) {
+			if (ready()) {
+				return;
+			}
+			std::this_thread::yield();
+		}
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Sleepers.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_Wake.wait(lock, ready);
+		m_Sleepers.fetch_sub(1);
+	}
+
+	/**
+	 * Wakes up the sleeping threads, if there are any.
+	 */
+	void notify() {
+		// Pairs with the fence in wait: either the sleeper sees the change or
+		// we see the sleeper
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_Sleepers.load(std::memory_order_relaxed) == 0) {
+			return;
+		}
+		{
+			// The sleeper checks the condition with the lock held, so taking
+			// it here makes sure it's either before the check or sleeping
+			std::lock_guard<std::mutex> lock(m_Mutex);
+		}
+		m_Wake.notify_all();
+	}
+
+private:
+	std::atomic<u32> m_Sleepers{ 0 };
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+};
+
+/**
+ * A blocking interface over a bounded queue. Pushing waits while the queue is
+ * full and popping waits while it's empty.
+ */
+template <typename Queue>
+struct channel {
+	using value_type = typename Queue::value_type;
+
+	explicit channel(std::size_t capacity)
+		: m_Queue(capacity) {
+	}
+
+	/**
+	 * Enqueues an element, waiting for room if needed.
+	 * @param val The element.
+	 */
+	void push(value_type val) {
+		m_NotFull.wait([&] { return m_Queue.try_push(std::move(val)); });
+		m_NotEmpty.notify();
+	}
+
+	/**
+	 * Enqueues an element without waiting.
+	 * @param val The element, only moved from on success.
+	 * @return False, if the queue is full.
+	 */
+	bool try_push(value_type&& val) {
+		if (!m_Queue.try_push(std::move(val))) {
+			return false;
+		}
+		m_NotEmpty.notify();
+		return true;
+	}
+
+	/**
+	 * Dequeues an element, waiting for one if needed.
+	 * @return The element.
+	 */
+	value_type pop() {
+		value_type res;
+		m_NotEmpty.wait([&] { return m_Queue.try_pop(res); });
+		m_NotFull.notify();
+		return res;
+	}
+
+	/**
+	 * Dequeues the next element without waiting, if it's already there and
+	 * satisfies a condition. Needs a queue that can peek.
+	 * @param pred The condition.
+	 * @return The element, or nullopt if there's no such element.
+	 */
+	template <typename Pred>
+	std::optional<value_type> try_pop_if(Pred&& pred) {
+		auto* front = m_Queue.peek();
+		if (!front || !pred(*front)) {
+			return std::nullopt;
+		}
+		value_type res;
+		m_Queue.try_pop(res);
+		m_NotFull.notify();
+		return res;
+	}
+
+private:
+	Queue m_Queue;
+	parker m_NotEmpty;
+	parker m_NotFull;
+};
+
+template <typename T>
+using spsc_channel = channel<spsc_queue<T>>;
+
+template <typename T>
+using mpsc_channel = channel<mpsc_queue<T>>;
+
+} /* namespace lsp */
+
+#endif /* LSP_QUEUE_HPP */
@@ -19,11 +19,14 @@ json request::to_json() const {
 json response::to_json() const {
 	auto res = pass({
 		{ "id", m_ID },
-		{ "result", result() },
 	});
+	// A response has either a result or an error
 	if (auto const& err = error()) {
 		res["error"] = err->to_json();
 	}
+	else {
+		res["result"] = result();
+	}
 	return res;
 }
 
@@ -42,7 +45,11 @@ json message::to_json() const {
 }
 
 message message::parse(char const* msg) {
-	auto js = json::parse(msg);
+	return parse(std::string_view(msg));
+}
+
+message message::parse(std::string_view msg) {
+	auto js = json::parse(msg.data(), msg.data() + msg.size());
 
 	auto id_it = js.find("id");
 	auto method_it = js.find("method");
@@ -10,6 +10,7 @@
 #define RPC_HPP
 
 #include <string>
+#include <string_view>
 #include <optional>
 #include <variant>
 #include "common.hpp"
@@ -90,6 +91,7 @@ struct response {
 		m_Result(std::forward<TRes>(result)),
 		m_Error(std::forward<TErr>(error)) {}
 
+	auto const& id() const { return m_ID; }
 	auto const& result() const { return m_Result; }
 	auto const& error() const { return m_Error; }
 
@@ -115,6 +117,7 @@ struct request {
 		m_Method(std::forward<TMethod>(method)),
 		m_Params(std::forward<TParams>(params)) {}
 
+	auto const& id() const { return m_ID; }
 	auto const& method() const { return m_Method; }
 	auto const& params() const { return m_Params; }
 
@@ -164,6 +167,14 @@ struct message {
 
 	static message parse(char const* msg);
 
+	/**
+	 * Parses a message that's not null-terminated, like a body that's still
+	 * in the buffer of the reader.
+	 * @param msg The JSON text of the message.
+	 * @return The parsed message.
+	 */
+	static message parse(std::string_view msg);
+
 	bool is_request() const {
 		return std::holds_alternative<request>(m_Data);
 	}
@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include "rpc.hpp"
+#include "transport.hpp"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+
+static long read_fd(int fd, char* buffer, std::size_t size) {
+	return _read(fd, buffer, unsigned(std::min<std::size_t>(size, 1u << 30)));
+}
+
+static long write_fd(int fd, char const* buffer, std::size_t size) {
+	return _write(fd, buffer, unsigned(std::min<std::size_t>(size, 1u << 30)));
+}
+
+// There's no polling of pipes, a blocked read is cancelled instead
+
+static void open_wake(int (&wake)[2]) {
+	wake[0] = wake[1] = -1;
+}
+
+static void close_wake(int (&)[2]) {
+}
+
+static void signal_wake(int (&)[2], int fd) {
+	CancelIoEx(HANDLE(_get_osfhandle(fd)), nullptr);
+}
+
+static bool wait_readable(int, int (&)[2]) {
+	return true;
+}
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+static long read_fd(int fd, char* buffer, std::size_t size) {
+	return long(::read(fd, buffer, size));
+}
+
+static long write_fd(int fd, char const* buffer, std::size_t size) {
+	return long(::write(fd, buffer, size));
+}
+
+static void open_wake(int (&wake)[2]) {
+	[[maybe_unused]] auto res = ::pipe(wake);
+	lsp_assert(res == 0);
+	// Don't leak the pipe into the processes we start
+	::fcntl(wake[0], F_SETFD, FD_CLOEXEC);
+	::fcntl(wake[1], F_SETFD, FD_CLOEXEC);
+}
+
+static void close_wake(int (&wake)[2]) {
+	::close(wake[0]);
+	::close(wake[1]);
+}
+
+static void signal_wake(int (&wake)[2], int) {
+	char c = 0;
+	while (::write(wake[1], &c, 1) < 0 && errno == EINTR);
+}
+
+/**
+ * Waits until the descriptor has something to read.
+ * @param fd The descriptor.
+ * @param wake The pipe that interrupts the waiting.
+ * @return False, if the waiting was interrupted.
+ */
+static bool wait_readable(int fd, int (&wake)[2]) {
+	pollfd fds[] = { { fd, POLLIN, 0 }, { wake[0], POLLIN, 0 } };
+	while (::poll(fds, 2, -1) < 0) {
+		if (errno != EINTR) {
+			// Let the read report the error
+			return true;
+		}
+	}
+	return !(fds[1].revents & POLLIN);
+}
+#endif
+
+namespace lsp {
+
+static constexpr std::string_view header_end = "\r\n\r\n";
+
+message_reader::message_reader(int fd, std::size_t capacity)
+	: m_Fd(fd), m_Interrupted(false),
+	m_Buffer(std::make_unique<char[]>(capacity)),
+	m_Capacity(capacity), m_Begin(0), m_End(0), m_Reads(0) {
+	open_wake(m_Wake);
+}
+
+message_reader::~message_reader() {
+	close_wake(m_Wake);
+}
+
+void message_reader::interrupt() {
+	m_Interrupted = true;
+	signal_wake(m_Wake, m_Fd);
+}
+
+std::optional<std::string_view> message_reader::next() {
+	auto end = find_header_end();
+	while (!end) {
+		// The header is small, but it could be split between reads
+		if (!fill(m_End - m_Begin + 1)) {
+			return std::nullopt;
+		}
+		end = find_header_end();
+	}
+
+	auto length = parse_content_length(
+		std::string_view(m_Buffer.get() + m_Begin, *end));
+	auto body = *end + header_end.size();
+	while (m_End - m_Begin < body + length) {
+		if (!fill(body + length)) {
+			return std::nullopt;
+		}
+	}
+	auto result = std::string_view(m_Buffer.get() + m_Begin + body, length);
+	m_Begin += body + length;
+	return result;
+}
+
+bool message_reader::fill(std::size_t need) {
+	if (m_Begin == m_End) {
+		m_Begin = m_End = 0;
+	}
+	if (m_Begin + need > m_Capacity) {
+		auto unread = m_End - m_Begin;
+		if (need > m_Capacity) {
+			// A message larger than the buffer, grow geometrically
+			auto capacity = std::max(need, m_Capacity * 2);
+			auto buffer = std::make_unique<char[]>(capacity);
+			std::memcpy(buffer.get(), m_Buffer.get() + m_Begin, unread);
+			m_Buffer = std::move(buffer);
+			m_Capacity = capacity;
+		}
+		else {
+			std::memmove(m_Buffer.get(), m_Buffer.get() + m_Begin, unread);
+		}
+		m_Begin = 0;
+		m_End = unread;
+	}
+	while (true) {
+		if (m_Interrupted || !wait_readable(m_Fd, m_Wake)) {
+			return false;
+		}
+		++m_Reads;
+		auto n = read_fd(m_Fd, m_Buffer.get() + m_End, m_Capacity - m_End);
+		if (n > 0) {
+			m_End += std::size_t(n);
+			return true;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		return false;
+	}
+}
+
+std::optional<std::size_t> message_reader::find_header_end() const {
+	auto const* begin = m_Buffer.get() + m_Begin;
+	auto const* end = m_Buffer.get() + m_End;
+	for (auto const* p = begin; p + header_end.size() <= end; ++p) {
+		p = static_cast<char const*>(std::memchr(p, '\r', end - p));
+		if (!p || p + header_end.size() > end) {
+			return std::nullopt;
+		}
+		if (std::memcmp(p, header_end.data(), header_end.size()) == 0) {
+			return std::size_t(p - begin);
+		}
+	}
+	return std::nullopt;
+}
+
+std::size_t message_reader::parse_content_length(std::string_view header) {
+	constexpr auto name = std::string_view("Content-Length:");
+	std::optional<std::size_t> length;
+	while (!header.empty()) {
+		auto eol = std::min(header.find("\r\n"), header.size());
+		auto line = header.substr(0, eol);
+		header.remove_prefix(std::min(eol + 2, header.size()));
+		if (line.substr(0, name.size()) != name) {
+			// We only care about the length, 'Content-Type' is ignored
+			continue;
+		}
+		line.remove_prefix(name.size());
+		std::size_t value = 0;
+		for (char c : line) {
+			if (c >= '0' && c <= '9') {
+				value = value * 10 + std::size_t(c - '0');
+			}
+			else {
+				lsp_assert(c == ' ');
+			}
+		}
+		length = value;
+	}
+	lsp_assert(length.has_value());
+	return length.value_or(0);
+}
+
+// json_writer
+
+void json_writer::separate() {
+	if (m_NeedComma) {
+		*m_Out += ',';
+	}
+}
+
+json_writer& json_writer::begin_object() {
+	separate();
+	*m_Out += '{';
+	m_NeedComma = false;
+	return *this;
+}
+
+json_writer& json_writer::end_object() {
+	*m_Out += '}';
+	m_NeedComma = true;
+	return *this;
+}
+
+json_writer& json_writer::begin_array() {
+	separate();
+	*m_Out += '[';
+	m_NeedComma = false;
+	return *this;
+}
+
+json_writer& json_writer::end_array() {
+	*m_Out += ']';
+	m_NeedComma = true;
+	return *this;
+}
+
+json_writer& json_writer::key(std::string_view name) {
+	value(name);
+	*m_Out += ':';
+	m_NeedComma = false;
+	return *this;
+}
+
+json_writer& json_writer::value(i32 val) {
+	separate();
+	char buf[16];
+	auto res = std::to_chars(buf, buf + sizeof(buf), val);
+	m_Out->append(buf, res.ptr);
+	m_NeedComma = true;
+	return *this;
+}
+
+json_writer& json_writer::value(std::string_view val) {
+	static constexpr char hex[] = "0123456789abcdef";
+	separate();
+	*m_Out += '"';
+	auto run = val.begin();
+	for (auto it = val.begin(); it != val.end(); ++it) {
+		char c = *it;
+		if (c != '"' && c != '\\' && u8(c) >= 0x20) {
+			continue;
+		}
+		// Copy the plain characters in one go
+		m_Out->append(run, it);
+		run = it + 1;
+		switch (c) {
+		case '"': *m_Out += "\\\""; break;
+		case '\\': *m_Out += "\\\\"; break;
+		case '\n': *m_Out += "\\n"; break;
+		case '\r': *m_Out += "\\r"; break;
+		case '\t': *m_Out += "\\t"; break;
+		default: {
+			char esc[] = { '\\', 'u', '0', '0', hex[u8(c) >> 4], hex[u8(c) & 0xf] };
+			m_Out->append(esc, sizeof(esc));
+		} break;
+		}
+	}
+	m_Out->append(run, val.end());
+	*m_Out += '"';
+	m_NeedComma = true;
+	return *this;
+}
+
+json_writer& json_writer::value(json const& val) {
+	separate();
+	auto ser = nlohmann::detail::serializer<json>(
+		nlohmann::detail::output_adapter<char>(*m_Out), ' ');
+	ser.dump(val, false, false, 0);
+	m_NeedComma = true;
+	return *this;
+}
+
+void write_message(json_writer& w, rpc::message const& msg) {
+	w.begin_object();
+	w.member("jsonrpc", "2.0");
+	if (msg.is_request()) {
+		auto const& req = msg.as_request();
+		w.member("id", req.id());
+		w.member("method", req.method());
+		w.member("params", req.params());
+	}
+	else if (msg.is_response()) {
+		auto const& res = msg.as_response();
+		w.member("id", res.id());
+		// A response has either a result or an error
+		if (auto const& err = res.error()) {
+			w.member("error", err->to_json());
+		}
+		else {
+			w.member("result", res.result());
+		}
+	}
+	else {
+		lsp_assert(msg.is_notification());
+		auto const& noti = msg.as_notification();
+		w.member("method", noti.method());
+		w.member("params", noti.params());
+	}
+	w.end_object();
+}
+
+// message_writer
+
+static constexpr std::string_view length_prefix = "Content-Length: ";
+// Enough room for the prefix, any length and the empty line
+static constexpr std::size_t header_slot = length_prefix.size() + 20 + 4;
+
+message_writer::message_writer(int fd, std::size_t capacity)
+	: m_Fd(fd), m_Writes(0) {
+	m_Buffer.reserve(capacity);
+}
+
+json_writer message_writer::begin() {
+	// clear() keeps the capacity, so a warm writer doesn't allocate
+	m_Buffer.clear();
+	m_Buffer.append(header_slot, ' ');
+	return json_writer(m_Buffer);
+}
+
+void message_writer::finish() {
+	// Write the header right before the body, backwards
+	auto length = m_Buffer.size() - header_slot;
+	char digits[20];
+	auto res = std::to_chars(digits, digits + sizeof(digits), length);
+	auto n_digits = std::size_t(res.ptr - digits);
+	auto start = header_slot - 4 - n_digits - length_prefix.size();
+	auto* p = m_Buffer.data() + start;
+	std::memcpy(p, length_prefix.data(), length_prefix.size());
+	p += length_prefix.size();
+	std::memcpy(p, digits, n_digits);
+	p += n_digits;
+	std::memcpy(p, header_end.data(), header_end.size());
+
+	auto const* data = m_Buffer.data() + start;
+	auto size = m_Buffer.size() - start;
+	while (size > 0) {
+		++m_Writes;
+		auto n = write_fd(m_Fd, data, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// The client is gone, there's no one to report to
+			return;
+		}
+		data += n;
+		size -= std::size_t(n);
+	}
+}
+
+} /* namespace lsp */
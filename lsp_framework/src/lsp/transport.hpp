@@ -0,0 +1,246 @@
+/**
+ * transport.hpp
+ *
+ * @author Peter Lenkefi
+ * @date 2026-10-16
+ * @description Buffered reading and writing of the framed LSP messages right
+ * from and to file descriptors.
+ */
+
+#ifndef LSP_TRANSPORT_HPP
+#define LSP_TRANSPORT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "common.hpp"
+
+namespace lsp {
+
+namespace rpc {
+	struct message;
+} /* namespace rpc */
+
+/**
+ * Reads messages from a file descriptor into a reusable buffer. The buffer is
+ * filled with large reads, so a message usually needs a single read call, or
+ * none when the client sent more messages at once. The header end is found
+ * with memchr, that is vectorized, and the bodies are handed out in place,
+ * without copying them.
+ *
+ * The unread bytes are moved to the front of the buffer when more space is
+ * needed, so the body of a message is always contiguous. The buffer only
+ * grows when a single message doesn't fit in it.
+ *
+ * A read waiting for the input can be interrupted from another thread. The
+ * descriptor is polled together with a pipe, and interrupting writes to the
+ * pipe.
+ */
+struct message_reader {
+	/**
+	 * Creates a reader.
+	 * @param fd The file descriptor to read from (like 0 for the standard
+	 * input).
+	 * @param capacity The initial size of the buffer in bytes.
+	 */
+	explicit message_reader(int fd, std::size_t capacity = 64 * 1024);
+
+	message_reader(message_reader const&) = delete;
+	message_reader& operator=(message_reader const&) = delete;
+
+	~message_reader();
+
+	/**
+	 * Ends the input early. A next() call waiting for the input returns
+	 * nullopt, and so does every call after it. Can be called from any
+	 * thread.
+	 */
+	void interrupt();
+
+	/**
+	 * Reads the next message.
+	 * @return The body of the message, or nullopt at the end of the input. The
+	 * view is only valid until the next call.
+	 */
+	std::optional<std::string_view> next();
+
+	/**
+	 * Returns the number of read calls made so far.
+	 * @return The number of system calls.
+	 */
+	u64 reads() const { return m_Reads; }
+
+private:
+	/**
+	 * Reads more bytes into the buffer, making room first if needed.
+	 * @param need The number of unread bytes the buffer has to be able to
+	 * hold.
+	 * @return False, if the input has ended.
+	 */
+	bool fill(std::size_t need);
+
+	/**
+	 * Finds the empty line that ends the header.
+	 * @return The offset of "\r\n\r\n" from the start of the unread bytes, or
+	 * nullopt if it's not in the buffer yet.
+	 */
+	std::optional<std::size_t> find_header_end() const;
+
+	/**
+	 * Parses the header.
+	 * @param header The header lines, without the closing empty line.
+	 * @return The value of Content-Length.
+	 */
+	static std::size_t parse_content_length(std::string_view header);
+
+	int m_Fd;
+	int m_Wake[2]; // The pipe that interrupts the waiting
+	std::atomic<bool> m_Interrupted;
+	std::unique_ptr<char[]> m_Buffer;
+	std::size_t m_Capacity;
+	std::size_t m_Begin; // The first unread byte
+	std::size_t m_End; // The end of the read bytes
+	u64 m_Reads;
+};
+
+/**
+ * Serializes JSON text right into a string, without building a DOM first. The
+ * separators are inserted automatically, so objects are written as a sequence
+ * of key() and value calls.
+ */
+struct json_writer {
+	explicit json_writer(std::string& out)
+		: m_Out(&out) {
+	}
+
+	json_writer& begin_object();
+	json_writer& end_object();
+	json_writer& begin_array();
+	json_writer& end_array();
+
+	/**
+	 * Writes the key of the next member of an object.
+	 * @param name The key.
+	 * @return This writer.
+	 */
+	json_writer& key(std::string_view name);
+
+	json_writer& value(i32 val);
+	json_writer& value(std::string_view val);
+	json_writer& value(char const* val) { return value(std::string_view(val)); }
+	json_writer& value(std::string const& val) { return value(std::string_view(val)); }
+
+	/**
+	 * Writes an already built JSON value, for the messages that have no
+	 * direct serialization.
+	 * @param val The value to write.
+	 * @return This writer.
+	 */
+	json_writer& value(json const& val);
+
+	/**
+	 * Writes a member of an object.
+	 * @param name The key of the member.
+	 * @param val The value of the member.
+	 * @return This writer.
+	 */
+	template <typename T>
+	json_writer& member(std::string_view name, T const& val) {
+		return key(name).value(val);
+	}
+
+	/**
+	 * Writes a member of an object only if the value is present.
+	 * @param name The key of the member.
+	 * @param val The optional value of the member.
+	 * @return This writer.
+	 */
+	template <typename T>
+	json_writer& opt_member(std::string_view name, std::optional<T> const& val) {
+		if (val) {
+			key(name).value(*val);
+		}
+		return *this;
+	}
+
+private:
+	void separate();
+
+	std::string* m_Out;
+	bool m_NeedComma = false;
+};
+
+/**
+ * Writes the JSON body of an RPC message. The parameters and the results are
+ * written from the DOM they are already stored in.
+ * @param w The writer to write with.
+ * @param msg The message to write.
+ */
+void write_message(json_writer& w, rpc::message const& msg);
+
+/**
+ * Writes framed messages to a file descriptor. The message is serialized
+ * after a reserved header slot in a buffer that's reused between messages.
+ * The Content-Length is patched in before the body when it's known, so the
+ * whole message leaves with a single write call and no copy of the payload.
+ */
+struct message_writer {
+	/**
+	 * Creates a writer.
+	 * @param fd The file descriptor to write to (like 1 for the standard
+	 * output).
+	 * @param capacity The initial size of the buffer in bytes.
+	 */
+	explicit message_writer(int fd, std::size_t capacity = 64 * 1024);
+
+	message_writer(message_writer const&) = delete;
+	message_writer& operator=(message_writer const&) = delete;
+
+	/**
+	 * Writes a message with the given body.
+	 * @param body A function taking a json_writer that writes the JSON body.
+	 */
+	template <typename Fn>
+	void send(Fn&& body) {
+		auto w = begin();
+		body(w);
+		finish();
+	}
+
+	/**
+	 * Writes an RPC message.
+	 * @param msg The message to write.
+	 */
+	void write(rpc::message const& msg) {
+		send([&](json_writer& w) { write_message(w, msg); });
+	}
+
+	/**
+	 * Returns the number of write calls made so far.
+	 * @return The number of system calls.
+	 */
+	u64 writes() const { return m_Writes; }
+
+private:
+	/**
+	 * Starts a new message, reserving the room for the header.
+	 * @return The writer for the body.
+	 */
+	json_writer begin();
+
+	/**
+	 * Fills in the header and writes out the message.
+	 */
+	void finish();
+
+	int m_Fd;
+	std::string m_Buffer;
+	u64 m_Writes;
+};
+
+} /* namespace lsp */
+
+#endif /* LSP_TRANSPORT_HPP */